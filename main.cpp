@@ -2,13 +2,46 @@
 #include <vector>
 #include <algorithm>
 #include <map>
+#include <unordered_map>
 #include <string>
-#include <regex>
 #include <fmt/base.h>
+#include <fmt/format.h>
 #include <fmt/ranges.h>
 #include <variant>
 #include <fstream>
 #include <filesystem>
+#include <charconv>
+#include <cstring>
+#include <array>
+#include <span>
+#include <bit>
+#include <chrono>
+#include <random>
+#include <memory>
+#include <utility>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <limits>
+#include <cmath>
+#include <optional>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SQL_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 
 /* This project emulates a simplified Structured Query Language (SQL) engine.
@@ -18,10 +51,14 @@
  *     * The database engine uses the classes `Tables` and `RowColumn`, combined with `std::map`, for in-memory storage.
  *       The core idea is to represent data in the form of:
  *
- *         map< tableName, map< string, vector<ReferencedType> > >
+ *         map< tableName, RowColumn{ TableSchema, vector<Column> } >
  *
- *       Here, the inner map represents the table schema, where each key is a column name and the value is a vector
- *       holding the data for that column.
+ *       Here, `TableSchema` is the catalog entry of the table: column names, types, ordinal positions and the
+ *       primary key. Each `Column` sits at the ordinal of its schema entry: float cells are kept in a contiguous
+ *       buffer, int cells in an `IntColumn` whose complete 64K-row groups are compressed (run-length, frame of
+ *       reference, delta), and strings in a separate `StringColumn`, dictionary-encoded while the column has few
+ *       distinct values. Per 64K-row group a column also keeps a min / max zone map, which lets filters skip
+ *       groups that cannot match. Tables start without rows.
  *
  * -- Features:
  *
@@ -84,7 +121,7 @@
  *     * Primary keys can be defined directly in the `create` statement. Multiple `create` statements can be combined
  *       and executed as a single query.
  *
- *     * Different types of `create`, `insert`, and `alter` statements can also be written in a single query.
+ *     * Any statements can also be written in a single query or file; they are executed in the order written.
  *
  *     * The `alter` statement allows:
  *         - Adding foreign keys
@@ -96,11 +133,19 @@
  *             alter table person drop email
  *
  *     * The `insert` statement uses the first pair of parentheses to specify the target columns and the second
- *       pair to provide the corresponding values.
+ *       pair to provide the corresponding values. Values containing spaces or commas are written in single quotes:
+ *
+ *             insert into person ( id, name ) values ( 7, 'Anna Maria' )
+ *
+ *       Several rows can be inserted by one statement; if any row is rejected, none of them is inserted:
+ *
+ *             insert into person ( id, name ) values ( 8, Ann ), ( 9, Bob ), ( 10, Eve )
+ *
+ *     * Keywords are case-insensitive; table and column names and values are case-sensitive.
  *
  *     * The `select` statement allows specifying either a list of columns or using the `*` wildcard.
  *       WHERE conditions support operators like: `>`, `<`, `<=`, `>=`, `=` and can be combined with
- *       logical operators like `and`, `or`.
+ *       logical operators like `and`, `or`. `and` binds tighter than `or`, parentheses can be used for grouping.
  *
  *         Examples:
  *
@@ -111,6 +156,8 @@
  *             from TableName
  *             where column >= 1 and column <= 5
  *
+ *             select * from TableName where ( column = 1 or column = 5 ) and column1 = name
+ *
  *     * The `update` statement allows modifying existing data in the database. It supports WHERE conditions
  *       in the same format as `select`.
  *
@@ -123,1097 +170,5618 @@
  *
  *         drop table TableName
  *
- *     * It is possible to load a state from .sql file
+ *     * It is possible to load a state from .sql file. The file is streamed: every statement runs as soon as it has
+ *       been read, and progress is reported while large files load.
  *
  *          Example:
  *               load path
  *
+ *     * CSV or TSV files with a header line naming the columns can be bulk loaded into an existing table; the file is
+ *       parsed on all cores and the whole file is rejected if a value or constraint is invalid
+ *
+ *          Example:
+ *                copy person from people.csv
+ *                copy person from people.tsv tsv
+ *
+ *     * A table, or the rows matching a WHERE clause, can be exported to CSV or TSV in the same format:
+ *
+ *          Example:
+ *                copy person to people.csv
+ *                copy person to adults.tsv tsv where age >= 18
+ *
  *     * it is possible to save a state to file .txt ( if during the execution user did not use `save`, during program
  *       termination there will be a request to provide a path for saving the state. If `save` was used, during
  *       program termination the state will be saved to the last used path provided to `save`)
  *
  *          Example:
  *                save path
+ *
+ *     * A path ending in `.snap` makes `save` write a binary snapshot instead: catalog, raw column buffers and
+ *       primary key indexes with checksums. `load` recognises snapshots and restores them without replaying SQL or
+ *       re-checking constraints; the loaded snapshot replaces all tables.
+ *
+ *          Example:
+ *                save backup.snap
+ *                load backup.snap
+ *
+ *     * `open` restores a snapshot without reading it: columns and indexes point into the memory-mapped file, so it
+ *       takes the same time for any size. A column or index is copied into memory the first time it is modified.
+ *       Checksums of the data are not verified; use `load` for that.
+ *
+ *          Example:
+ *                open backup.snap
+ *
+ *     * Started with a data directory, the program keeps its state there: a snapshot plus a write-ahead log of every
+ *       change since, replayed at the next start. `checkpoint` (also `exit`, and automatically once the log is
+ *       large) folds the log into a new snapshot in the background, writing only the tables that changed;
+ *       `set sync` chooses whether each statement is synced to disk, groups of them every few milliseconds, or none.
+ *
+ *          Example:
+ *                cpp_Project data
+ *                set sync always
+ *                checkpoint
+ *
+ *     * The format of `select` results can be changed for the rest of the session: the padded table (default),
+ *       CSV, tab-separated values, or `quiet` which only reports the number of matching rows
+ *
+ *          Example:
+ *                set output csv
+ *
+ *     * The WHERE comparison kernels can be measured against the scalar implementation, and appending string
+ *       batches (as COPY and log replay do) checked across the switch from dictionary to plain strings:
+ *
+ *          Example:
+ *                bench filter 16000000
+ *                bench append 1000000
  */
 
 using namespace std;
 
 using ColumnValue = variant<int, float, string>;  // Define possible types for columns
 
+// Type of a column, recorded once in the schema when the column is created
+enum class ColumnType : uint8_t {
+    Int,
+    Float,
+    String
+};
 
-void printColumnValue(const ColumnValue &value) {
-    // Use fmt::print to handle different types in the variant
-    visit([](const auto &val) { fmt::print("{} ", val); }, value);
+bool parseColumnType(string_view name, ColumnType &type) {
+    if (name == "int") {
+        type = ColumnType::Int;
+    } else if (name == "float") {
+        type = ColumnType::Float;
+    } else if (name == "string") {
+        type = ColumnType::String;
+    } else {
+        return false;
+    }
+    return true;
 }
 
 
-std::string toString(const ColumnValue &val) {
-    return visit([](auto &&arg) -> std::string {
-        ostringstream oss;
-        oss << arg;
-        return oss.str();
-    }, val);
+ColumnValue defaultColumnValue(ColumnType type) {
+    if (type == ColumnType::Int) {
+        return 0;
+    } else if (type == ColumnType::Float) {
+        return 0.0f;
+    }
+    return string();
 }
 
 
-struct ForeignKey {
-    string referencingTable;
-    vector<std::string> referencingColumns;
+// Converts the textual value of a statement into a value of the given column type
+// The whole text has to be a valid value, otherwise false is returned
+bool parseColumnValue(string_view text, ColumnType type, ColumnValue &value) {
+    const char *end = text.data() + text.size();
+    from_chars_result parsed{end, errc()};
+    if (type == ColumnType::Int) {
+        int number = 0;
+        parsed = from_chars(text.data(), end, number);
+        value = number;
+    } else if (type == ColumnType::Float) {
+        float number = 0.0f;
+        parsed = from_chars(text.data(), end, number);
+        value = number;
+    } else {
+        value = string(text);
+    }
+    return parsed.ec == errc() && parsed.ptr == end;
+}
 
-    string referencedTable;
-    vector<std::string> referencedColumns;
-};
 
-template<typename T>
-class RowColumn {
-public:
-    map<string, vector<ColumnValue>> rowColumn;
-};
+uint64_t hashColumnValue(const ColumnValue &val) {
+    return visit([](const auto &arg) -> uint64_t {
+        using V = decay_t<decltype(arg)>;
+        if constexpr (is_same_v<V, string>) {
+            return hash<string_view>{}(arg);
+        } else {
+            return hash<V>{}(arg);
+        }
+    }, val);
+}
 
-template<typename T>
-class Tables {
+uint64_t combineHash(uint64_t seed, uint64_t value) {
+    return seed ^ (value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2));
+}
+
+
+/* Cells of a fixed-width column. Normally an owned vector; a column opened from a snapshot views the mapped file
+ * instead (kept alive by `owner`) and copies its cells into the vector on the first modification. Reads never copy,
+ * so only the operations below and `own()` can trigger the copy. `share()` views an owned vector the same way, so a
+ * checkpoint can read the cells while the table goes on changing.
+ */
+template<typename V>
+class ColumnBuffer {
 public:
-    map<string, RowColumn<T>> tables;
-    map<string, vector<string>> primaryKeys;
-    vector<ForeignKey> foreignKeys;
+    size_t size() const { return mapped ? mappedSize : values.size(); }
 
-    string savingPath;
-};
+    bool empty() const { return size() == 0; }
 
+    const V *data() const { return mapped ? mapped : values.data(); }
 
-class WhereCondition {
-public:
-    string column;
-    string operation;
-    string value;
+    const V &operator[](size_t i) const { return data()[i]; }
 
-    WhereCondition(string col, string op, string val)
-            : column(col), operation(op), value(val) {}
-};
+    const V *begin() const { return data(); }
 
-class WherePattern {
-public:
-    vector<WhereCondition> conditions;  // Stores all conditions
-    vector<string> logicalOperators;    // Stores logical operators like AND, OR
-};
+    const V *end() const { return data() + size(); }
 
+    bool isMapped() const { return mapped != nullptr; }
 
-void deleteTable(string &tableName, Tables<int> &tables) {
-    tables.tables.erase(tableName);
-}
+    size_t capacity() const { return mapped ? mappedSize : values.capacity(); }
 
-namespace DBCommands {
-    const string create = "create";
-    const string insert = "insert";
-    const string select = "select";
-    const string where = "where";
-    const string alter = "alter";
-    const string foreign = "foreign";
-    const string add = "add";
-    const string drop = "drop";
-    const string load = "load";
-    const string save = "save";
-    const string update = "update";
-}
-
-
-void toLower(vector<string> &query) {
-    for (string &str: query) {
-        transform(str.begin(), str.end(), str.begin(), [](unsigned char c) {
-            return tolower(c);
-        });
+    void map(const V *cells, size_t count, shared_ptr<const void> file) {
+        values = vector<V>();
+        mapped = cells;
+        mappedSize = count;
+        owner = std::move(file);
     }
-}
 
-vector<string> deleteSpaces(string &line) {
-    regex rgx("\\s+");
+    // The cells as an owned vector, for modification
+    vector<V> &own() {
+        if (mapped) {
+            values.assign(mapped, mapped + mappedSize);
+            mapped = nullptr;
+            mappedSize = 0;
+            owner.reset();
+        }
+        return values;
+    }
 
-    // Use regex to split the string by one or more spaces
-    vector<std::string> words(
-            sregex_token_iterator(line.begin(), line.end(), rgx, -1),
-            sregex_token_iterator()
-    );
+    void push_back(const V &value) { own().push_back(value); }
 
-    // Return the vector of words
-    return words;
-}
+    void set(size_t i, const V &value) { own()[i] = value; }
 
-bool processPrimaryKeysWithCreate(vector<string> query, Tables<int> &tables) {
-    vector<vector<string>::iterator> primaryLocationVector;
-    for (auto i = query.begin(); i != query.end(); i++) {
-        if (*i == "primary") {
-            primaryLocationVector.push_back(i);
+    // A read-only copy of the cells. Owned cells move to a shared vector that both buffers view, so this one copies
+    // them back on its next modification and the copy never changes.
+    ColumnBuffer share() {
+        if (!mapped) {
+            auto cells = make_shared<const vector<V>>(std::move(values));
+            map(cells->data(), cells->size(), cells);
         }
+        return *this;
     }
 
-    if (primaryLocationVector.empty()) {
-        fmt::println("{}", "no primary key in table !");
-        return false;
+private:
+    vector<V> values;
+    const V *mapped = nullptr;
+    size_t mappedSize = 0;
+    shared_ptr<const void> owner;
+};
+
+
+/* -- Zone maps:
+ *
+ *     Rows are grouped into row groups of `zoneRows`; a zone holds the smallest and largest cell of one complete
+ *     group, int and float cells by value and strings by their stringPrefixKey. A filter skips every group whose
+ *     zone rules out its WHERE clause, so a range predicate on ordered data (ids, timestamps) only scans the few
+ *     groups the range overlaps.
+ *
+ *     Zones are built when a filter first asks for them and kept with the column. Appended rows never change a
+ *     complete group, an update widens the zone of its row, and shrinking the column drops the zones past its end.
+ *     NaN cells are left out of float zones: no comparison accepts them.
+ */
+constexpr size_t zoneRows = 1 << 16;
+
+struct Zone {
+    double min = numeric_limits<double>::infinity();
+    double max = -numeric_limits<double>::infinity();
+
+    void widen(double key) {
+        if (key < min) min = key;
+        if (key > max) max = key;
     }
-    for (auto primaryLocation: primaryLocationVector) {
-        auto keyLocation = primaryLocation + 1;
+};
 
-        if (*(keyLocation + 1) == "(") {
-            auto tableName = query[1];
-            auto nameOfPrimaryKeyColumn = *(keyLocation + 2);
 
-            if (!(tables.tables[tableName].rowColumn.contains(nameOfPrimaryKeyColumn))) {
-                fmt::println("no such column exist {}", nameOfPrimaryKeyColumn);
-                tables.primaryKeys.erase(tableName);
-                return false;
-            }
+/* Cells of a fixed-width column in row groups: every complete group of `zoneRows` cells is a chunk shared through a
+ * shared_ptr, the rest is a ColumnBuffer tail. `share()` only copies the chunk pointers and `at()` copies the one
+ * chunk it modifies while a copy still holds it, so the first write after a checkpoint costs a row group, not the
+ * column. The cells of one row group are contiguous.
+ */
+template<typename V>
+class ChunkedBuffer {
+public:
+    size_t size() const { return sealedRows() + tail.size(); }
 
-            tables.primaryKeys[tableName].push_back(nameOfPrimaryKeyColumn);
-            continue;
-        } else {
-            auto tableName = query[1];
-            auto nameOfPrimaryKeyColumn = *(primaryLocation - 2);
-            if (!(tables.tables[tableName].rowColumn.contains(nameOfPrimaryKeyColumn))) {
-                fmt::println("no such column exist {}", nameOfPrimaryKeyColumn);
-                tables.primaryKeys.clear();
-                return false;
-            }
-            tables.primaryKeys[tableName].push_back(nameOfPrimaryKeyColumn);
-        }
+    bool empty() const { return size() == 0; }
 
+    const V &operator[](size_t row) const {
+        size_t chunk = row / zoneRows;
+        return chunk < chunks.size() ? (*chunks[chunk])[row % zoneRows] : tail[row - sealedRows()];
     }
-    return true;
 
-}
+    // The cells from `row` to the end of its row group
+    const V *cells(size_t row) const {
+        size_t chunk = row / zoneRows;
+        return chunk < chunks.size() ? chunks[chunk]->data() + row % zoneRows : tail.data() + (row - sealedRows());
+    }
 
+    // Writes the cells [first, first + rows) to `out`
+    void copyTo(size_t first, size_t rows, V *out) const {
+        while (rows > 0) {
+            size_t count = first < sealedRows() ? min(rows, zoneRows - first % zoneRows) : rows;
+            out = copy_n(cells(first), count, out);
+            first += count;
+            rows -= count;
+        }
+    }
 
-void processCreate(vector<string> query, Tables<int> &tables) {
+    void map(const V *values, size_t count, shared_ptr<const void> file) {
+        chunks = vector<shared_ptr<vector<V>>>();
+        tail.map(values, count, std::move(file));
+    }
 
-    string tableName = query[1];
+    void assign(const V *values, size_t count) {
+        chunks = vector<shared_ptr<vector<V>>>();
+        tail = ColumnBuffer<V>();
+        append(values, count);
+    }
 
-    // Initialize the RowColumn for this table
-    RowColumn<int> data;
+    void push_back(const V &value) {
+        tail.push_back(value);
+        seal();
+    }
 
-    // Process the column definitions inside parentheses
-    bool insideParentheses = false;
-    string currentColumnName;
-    string currentColumnType;
+    void append(const V *values, size_t count) {
+        while (count > 0) {
+            size_t rows = tail.size() < zoneRows ? min(count, zoneRows - tail.size()) : count;
+            tail.own().insert(tail.own().end(), values, values + rows);
+            seal();
+            values += rows;
+            count -= rows;
+        }
+    }
 
-    for (int i = 2; i < query.size(); ++i) {
-        string word = query[i];
-        if (word == "primary") {
-            if (query[i + 1] == "key") {
-                if (query[i + 2] == "(") {
-                    i = i + 4;
-                    continue;
-                }
-                i = i + 1;
-                continue;
+    // Moves all cells of `other` to the end of this buffer; its chunks are taken over as they are when this buffer
+    // ends on a row group boundary
+    void append(ChunkedBuffer &&other) {
+        for (shared_ptr<vector<V>> &chunk: other.chunks) {
+            if (tail.empty()) {
+                chunks.push_back(std::move(chunk));
+            } else {
+                append(chunk->data(), chunk->size());
             }
         }
-        if (word == "(") {
-            insideParentheses = true;
-            continue;
-        }
-        if (word == ")") {
-            insideParentheses = false;
-            continue;
-        }
+        append(other.tail.data(), other.tail.size());
+        other = ChunkedBuffer();
+    }
 
-        if (insideParentheses) {
-            if (currentColumnName.empty()) {
-                // It's the column name
-                currentColumnName = word;
-            } else {
-                // It's the column type
-                currentColumnType = word;
+    // The cell at `row` for modification. A mapped tail is copied and sealed first, so later copies share its chunks.
+    V &at(size_t row) {
+        if (tail.isMapped()) {
+            tail.own();
+            seal();
+        }
+        size_t chunk = row / zoneRows;
+        if (chunk >= chunks.size()) return tail.own()[row - sealedRows()];
+        shared_ptr<vector<V>> &sealed = chunks[chunk];
+        if (sealed.use_count() > 1) sealed = make_shared<vector<V>>(*sealed);  // still read by a checkpoint
+        return (*sealed)[row % zoneRows];
+    }
 
-                // Initialize the vector with the appropriate default value
-                if (currentColumnType == "int") {
-                    // Store a vector of ColumnValue with a default value (int)
-                    data.rowColumn[currentColumnName] = {ColumnValue(0)};  // Correct for vector of ColumnValue
-                } else if (currentColumnType == "string") {
-                    // Store a vector of ColumnValue with a default value (empty string)
-                    data.rowColumn[currentColumnName] = {ColumnValue("")};  // Correct for vector of ColumnValue
-                } else if (currentColumnType == "float") {
-                    // Store a vector of ColumnValue with a default value (float)
-                    data.rowColumn[currentColumnName] = {ColumnValue(0.0f)};  // Correct for vector of ColumnValue
-                }
+    void set(size_t row, const V &value) { at(row) = value; }
 
-                // Reset for next column definition
-                currentColumnName.clear();
-                currentColumnType.clear();
-            }
+    // Grows or shrinks the buffer to `numRows`, new cells get `value`; only a chunk that the new end cuts is copied
+    void resize(size_t numRows, const V &value) {
+        if (numRows < sealedRows()) {
+            const vector<V> *cut = numRows % zoneRows != 0 ? chunks[numRows / zoneRows].get() : nullptr;
+            vector<V> cells = cut ? vector<V>(cut->begin(), cut->begin() + numRows % zoneRows) : vector<V>();
+            chunks.resize(numRows / zoneRows);
+            tail = ColumnBuffer<V>();
+            tail.own() = std::move(cells);
+        }
+        if (numRows < size()) tail.own().resize(numRows - sealedRows());
+        while (size() < numRows) {
+            size_t rows = tail.size() < zoneRows ? min(numRows - size(), zoneRows - tail.size()) : numRows - size();
+            tail.own().resize(tail.size() + rows, value);
+            seal();
         }
     }
 
-    // Add this table to the tables map
-    tables.tables[tableName] = data;
+    // Makes room for `numRows` cells; only the tail holds unsealed cells, so at most a row group of them is reserved.
+    // The tail's capacity at least doubles, so repeated batches stay amortised O(1) per row.
+    void reserve(size_t numRows) {
+        if (numRows / zoneRows > chunks.capacity()) chunks.reserve(max(numRows / zoneRows, chunks.capacity() * 2));
+        size_t tailRows = min(numRows - min(numRows, sealedRows()), zoneRows);
+        if (tailRows > tail.capacity()) tail.own().reserve(min(max(tailRows, tail.capacity() * 2), zoneRows));
+    }
 
-    if (!processPrimaryKeysWithCreate(query, tables)) {
-        deleteTable(tableName, tables);
+    // A read-only copy; the chunks are shared, `at` copies one before it modifies it while the copy holds it
+    ChunkedBuffer share() {
+        ChunkedBuffer copy;
+        copy.chunks = chunks;
+        copy.tail = tail.share();
+        return copy;
     }
 
-}
+private:
+    vector<shared_ptr<vector<V>>> chunks;
+    ColumnBuffer<V> tail;
 
-auto defineNumberOfInsertStatements(vector<string> query) {
-    vector<vector<string>> result;
-    vector<string>::iterator beginRange;
-    vector<string>::iterator endRange;
-    int countOfPassedParentheses;
+    size_t sealedRows() const { return chunks.size() * zoneRows; }
 
-    for (auto i = query.begin(); i != query.end(); ++i) {
-        if (*i == DBCommands::insert) {
-            int numberOfIterationsDone;
-            beginRange = i;
-            while (*i != "(") {
-                ++numberOfIterationsDone;
-                ++i;
+    // Moves every complete row group in the tail to a chunk of its own
+    void seal() {
+        if (tail.size() < zoneRows) return;
+        vector<V> &cells = tail.own();
+        size_t sealed = 0;
+        for (; sealed + zoneRows <= cells.size(); sealed += zoneRows) {
+            auto first = cells.begin() + static_cast<ptrdiff_t>(sealed);
+            chunks.push_back(make_shared<vector<V>>(first, first + zoneRows));
+        }
+        cells.erase(cells.begin(), cells.begin() + static_cast<ptrdiff_t>(sealed));
+        if (cells.capacity() > 2 * zoneRows) cells.shrink_to_fit();
+    }
+};
 
-            }
-            ++countOfPassedParentheses;
-            while (*i != ")") {
-                ++numberOfIterationsDone;
-                ++i;
-            }
-            ++countOfPassedParentheses;
-            if (countOfPassedParentheses == 2) {
-                endRange = i + numberOfIterationsDone;
-                vector<string> sub = vector<string>(beginRange, endRange);
-                result.push_back(sub);
-                countOfPassedParentheses = 0;
-                numberOfIterationsDone = 0;
-            }
 
-        }
+// Lets string-keyed maps (column ordinals, dictionary codes) be probed with a string_view without building a string
+struct StringHash {
+    using is_transparent = void;
+
+    size_t operator()(string_view value) const { return hash<string_view>{}(value); }
+};
+
+/* Variable-length cells of a string column, kept apart from the fixed-width numeric buffers, in one of three forms:
+ *
+ *     dictionary  every distinct value once plus a uint32 code per row; the form of every column while it is empty
+ *     plain       a 16-byte `StringCell` per row plus one byte heap for long values, once the dictionary holds
+ *                 more than `dictionaryMaxEntries` values or more than half as many values as the column has rows,
+ *                 counting at least `dictionaryMinRows`
+ *     mapped      offsets and bytes inside an opened snapshot, read-only; the first modification re-encodes it
+ *
+ * Low-cardinality columns thus store each value once, and `=` filters compare the codes instead of the strings.
+ * Values that an update replaced stay in the dictionary until the column is emptied.
+ *
+ * A cell holds the length and 12 bytes: the whole value if it is at most 12 bytes long, otherwise its first 4 bytes
+ * followed by the heap offset of the complete value. Short values never touch the heap, and a comparison of a
+ * long value is mostly decided by the inline prefix before the heap is read.
+ *
+ * The heap makes appending a long value a copy into a page rather than an allocation, and lets truncating or
+ * dropping a table free the column at once. An update that fits overwrites the old bytes in place, a longer value is
+ * appended; the heap is compacted once more than half of it is unreferenced. Codes and cells are ChunkedBuffers, so
+ * like the heap pages they stay shared with a checkpoint's copy until a row group of them is modified.
+ */
+constexpr size_t dictionaryMaxEntries = 1 << 16;
+constexpr size_t dictionaryMinRows = 1024;
+constexpr size_t stringHeapCompactMinBytes = 1 << 20;
+constexpr size_t stringHeapMinPageBytes = 1 << 12;
+constexpr size_t stringHeapMaxPageBytes = 1 << 20;
+constexpr size_t stringInlineBytes = 12;
+constexpr size_t stringPrefixBytes = 4;
+
+struct StringCell {
+    uint32_t length = 0;
+    array<char, stringInlineBytes> bytes{};  // the value, or its prefix followed by a uint64 heap offset
+
+    bool isInline() const { return length <= stringInlineBytes; }
+
+    // The first bytes as a big-endian number; unused bytes of a short value are zero
+    uint32_t prefixKey() const {
+        uint32_t key;
+        memcpy(&key, bytes.data(), sizeof(key));
+        return endian::native == endian::little ? byteswap(key) : key;
     }
 
-    return result;
-}
+    uint64_t offset() const {
+        uint64_t offset;
+        memcpy(&offset, bytes.data() + stringPrefixBytes, sizeof(offset));
+        return offset;
+    }
 
-auto processWhereStatement(const vector<string> &query) {
-    auto whereLoc = find(query.begin(), query.end(), DBCommands::where);
+    void setOffset(uint64_t offset) { memcpy(bytes.data() + stringPrefixBytes, &offset, sizeof(offset)); }
+};
 
-    // Create an empty WherePattern
-    WherePattern wherePattern;
+static_assert(sizeof(StringCell) == 16);
 
-    // Start reading from after the 'WHERE' keyword
-    auto conditionStart = whereLoc + 1;
-
-    // Parse conditions and operators
-    string currentColumn;
-    string currentOp;
-    string currentValue;
-    string currentOperator = "";  // Initialize as empty, will change to AND/OR
-
-    for (auto it = conditionStart; it != query.end(); ++it) {
-        // Handle logical operators (AND/OR) in a case-insensitive manner
-        if (*it == "and" || *it == "or") {
-            wherePattern.logicalOperators.push_back(*it);  // Store AND/OR
-        } else if (currentColumn.empty()) {
-            currentColumn = *it;  // First part of the condition (column)
-        } else if (currentOp.empty()) {
-            currentOp = *it;  // The operator part of the condition (e.g., >, <, =)
-        } else {
-            currentValue = *it;
+/* The prefix key of any value, as StringCell::prefixKey. Zero padding sorts before every byte, so two values whose
+ * keys differ are ordered like their keys; equal keys leave the order to the remaining bytes.
+ */
+uint32_t stringPrefixKey(string_view value) {
+    StringCell cell;
+    copy_n(value.begin(), min(value.size(), stringPrefixBytes), cell.bytes.begin());
+    return cell.prefixKey();
+}
+
+/* The long values of a plain string column, in pages that never move: a value goes to the end of the last page if
+ * it fits, otherwise to a new page twice as large as the last one, within `stringHeapMinPageBytes` and
+ * `stringHeapMaxPageBytes`, or as large as the value. A location holds the page number in its high 32 bits and the
+ * offset inside the page in the low ones.
+ *
+ * Copies share the pages. `add` starts a new page rather than writing to a shared one and `writable` copies the page
+ * it returns while a copy holds it, so a copy never sees a byte change.
+ */
+class StringHeap {
+public:
+    // Bytes added so far, referenced or not
+    size_t size() const { return bytes; }
 
+    const char *at(uint64_t location) const { return pages[location >> 32]->data() + (location & UINT32_MAX); }
 
-            wherePattern.conditions.push_back(WhereCondition(currentColumn, currentOp, currentValue));
+    char *writable(uint64_t location) {
+        shared_ptr<vector<char>> &page = pages[location >> 32];
+        if (page.use_count() > 1) page = make_shared<vector<char>>(*page);
+        return page->data() + (location & UINT32_MAX);
+    }
 
-            // Reset for the next condition
-            currentColumn.clear();
-            currentOp.clear();
-            currentValue.clear();
+    // Copies `value` into the heap and returns its location
+    uint64_t add(string_view value) {
+        if (pages.empty() || pages.back().use_count() > 1 ||
+            pages.back()->capacity() - pages.back()->size() < value.size()) {
+            size_t pageBytes = pages.empty() ? 0 : 2 * pages.back()->capacity();
+            auto page = make_shared<vector<char>>();
+            page->reserve(max(clamp(pageBytes, stringHeapMinPageBytes, stringHeapMaxPageBytes), value.size()));
+            pages.push_back(std::move(page));
         }
+        vector<char> &page = *pages.back();
+        uint64_t location = (uint64_t(pages.size() - 1) << 32) | page.size();
+        page.insert(page.end(), value.begin(), value.end());
+        bytes += value.size();
+        return location;
     }
 
-    return wherePattern;
-}
-
-void processSelect(const vector<string> &query, Tables<int> &tables) {
-    if (query.size() < 2) {
-        fmt::println("Invalid SELECT format.");
-        return;
+    // Moves the pages of `other` behind these; returns what the locations of its values have to be increased by
+    uint64_t append(StringHeap &&other) {
+        uint64_t shift = uint64_t(pages.size()) << 32;
+        pages.insert(pages.end(), make_move_iterator(other.pages.begin()), make_move_iterator(other.pages.end()));
+        bytes += other.bytes;
+        other = StringHeap();
+        return shift;
     }
 
-    if (find(query.begin(), query.end(), DBCommands::insert) != query.end() ||
-        find(query.begin(), query.end(), DBCommands::create) != query.end()) {
-        fmt::println("Select query cannot contain keywords for Insert or Create.");
-        return;
+private:
+    vector<shared_ptr<vector<char>>> pages;
+    size_t bytes = 0;
+};
+
+class StringColumn {
+public:
+    size_t size() const {
+        if (mappedOffsets) return mappedSize;
+        return encoded ? codes.size() : cells.size();
     }
 
-    bool isSelectingColumns = true;
-    vector<string> targetedColumns;
-    string tableName;
+    string_view operator[](size_t row) const {
+        if (mappedOffsets) {
+            return {mappedBytes + mappedOffsets[row], mappedOffsets[row + 1] - mappedOffsets[row]};
+        }
+        if (encoded) return dictionary[codes[row]];
+        const StringCell &cell = cells[row];
+        return {cell.isInline() ? cell.bytes.data() : heap.at(cell.offset()), cell.length};
+    }
 
-    for (auto it = query.begin() + 1; it != query.end(); ++it) {
-        if (*it == "from") {
-            isSelectingColumns = false;
-            continue;
+    // Negative, zero or positive as the cell at `row` orders before, equal to or after `value`, whose
+    // stringPrefixKey is `valuePrefix`. Plain cells are mostly decided by their prefix alone.
+    int compare(size_t row, string_view value, uint32_t valuePrefix) const {
+        if (!mappedOffsets && !encoded) {
+            uint32_t prefix = cells[row].prefixKey();
+            if (prefix != valuePrefix) return prefix < valuePrefix ? -1 : 1;
         }
+        return (*this)[row].compare(value);
+    }
 
-        if (isSelectingColumns) {
-            targetedColumns.push_back(*it);
-        } else {
-            tableName = *it;
-            break;
+    bool equals(size_t row, string_view value, uint32_t valuePrefix) const {
+        if (!mappedOffsets && !encoded) {
+            const StringCell &cell = cells[row];
+            if (cell.length != value.size() || cell.prefixKey() != valuePrefix) return false;
         }
+        return (*this)[row] == value;
     }
 
-    if (tables.tables.count(tableName) == 0) {
-        fmt::println("No such table exists: '{}'", tableName);
-        return;
+    bool cellsEqual(size_t lhs, size_t rhs) const {
+        return !mappedOffsets && encoded ? codes[lhs] == codes[rhs] : (*this)[lhs] == (*this)[rhs];
+    }
+
+    // The stringPrefixKey of the cell at `row`
+    uint32_t prefixKey(size_t row) const {
+        return !mappedOffsets && !encoded ? cells[row].prefixKey() : stringPrefixKey((*this)[row]);
     }
 
-    auto &columns = tables.tables[tableName].rowColumn;
+    bool isMapped() const { return mappedOffsets != nullptr; }
 
-    vector<string> actualColumnsToPrint;
-    bool isWherePresent = false;
-    WherePattern pattern;
+    bool isDictionaryEncoded() const { return !mappedOffsets && encoded; }
 
-    if (std::find(query.begin(), query.end(), DBCommands::where) != query.end()) {
-        pattern = processWhereStatement(query);
-        isWherePresent = true;
+    // The codes from `row` to the end of its row group
+    const uint32_t *codeData(size_t row) const { return codes.cells(row); }
+
+    // The code of `value`, or -1 if no cell of a dictionary-encoded column holds it
+    int64_t findCode(string_view value) const {
+        auto code = codeOf.find(value);
+        return code == codeOf.end() ? -1 : code->second;
     }
 
-    // Add targeted columns for SELECT
-    if (targetedColumns.size() == 1 && targetedColumns[0] == "*") {
-        // Select all columns
-        for (const auto &pair: columns) {
-            actualColumnsToPrint.push_back(pair.first);
-        }
-    } else {
-        for (const auto &target: targetedColumns) {
-            if (!columns.contains(target)) {
-                fmt::println("No such column '{}' in table '{}'", target, tableName);
+    // `offsets` holds count + 1 positions into `bytes`
+    void map(const uint64_t *offsets, const char *bytes, size_t count, shared_ptr<const void> file) {
+        clear();
+        mappedOffsets = offsets;
+        mappedBytes = bytes;
+        mappedSize = count;
+        owner = std::move(file);
+    }
+
+    void push_back(string_view value) {
+        materialize();
+        if (encoded) {
+            uint32_t code = encode(value);
+            if (encoded) {
+                codes.push_back(code);
                 return;
             }
-            actualColumnsToPrint.push_back(target);
         }
+        cells.push_back(store(value));
     }
 
-    // Print header
-    for (const auto &colName: actualColumnsToPrint) {
-        fmt::print("| {:15} ", colName);
-    }
-    fmt::print("|\n");
-
-    // Print separator
-    for (size_t i = 0; i < actualColumnsToPrint.size(); ++i) {
-        fmt::print("|{:-^17}", "");
-    }
-    fmt::print("|\n");
-
-    // Find number of rows
-    int numRows = columns.begin()->second.size();
-
-    // Print each row
-    for (int rowIdx = 1; rowIdx < numRows; ++rowIdx) {
-        bool conditionPass = true;  // Assume the row is valid until proven otherwise
-        bool hasPassedAnyCondition = false;  // For OR logic
-
-        // Evaluate WHERE conditions
-        if (isWherePresent) {
-            for (size_t i = 0; i < pattern.conditions.size(); ++i) {
-                const auto &condition = pattern.conditions[i];
-                const auto &columnData = columns.at(condition.column);
-                const auto &cell = columnData[rowIdx];
-
-                bool currentConditionPass = false;
-
-                // Check if the value in the column matches the operation
-                if (std::holds_alternative<int>(cell)) {
-                    int cellValue = std::get<int>(cell);
-                    int targetValue = std::stoi(condition.value);
-
-                    if (condition.operation == ">") {
-                        currentConditionPass = (cellValue > targetValue);
-                    } else if (condition.operation == "<") {
-                        currentConditionPass = (cellValue < targetValue);
-                    } else if (condition.operation == ">=") {
-                        currentConditionPass = (cellValue >= targetValue);
-                    } else if (condition.operation == "<=") {
-                        currentConditionPass = (cellValue <= targetValue);
-                    } else if (condition.operation == "=") {
-                        currentConditionPass = (cellValue == targetValue);
-                    }
-                } else if (std::holds_alternative<std::string>(cell)) {
-                    const std::string &cellValue = std::get<std::string>(cell);
-
-                    if (condition.operation == "=") {
-                        currentConditionPass = (cellValue == condition.value);
-                    } else if (condition.operation == ">") {
-                        currentConditionPass = (cellValue > condition.value);
-                    } else if (condition.operation == "<") {
-                        currentConditionPass = (cellValue < condition.value);
-                    } else if (condition.operation == ">=") {
-                        currentConditionPass = (cellValue >= condition.value);
-                    } else if (condition.operation == "<=") {
-                        currentConditionPass = (cellValue <= condition.value);
-                    }
-                }
-
-                // Apply logical operators:
-                if (pattern.logicalOperators.size() > 0 && i > 0) {
-                    if (pattern.logicalOperators[i - 1] == "and" && !currentConditionPass) {
-                        conditionPass = false;  // All must pass for AND
-                        break;  // No need to check further if it's an AND condition and failed
-                    }
-                    if (pattern.logicalOperators[i - 1] == "or" && currentConditionPass) {
-                        hasPassedAnyCondition = true;  // Only one needs to pass for OR
-                    }
-                } else {
-                    // For the first condition, we just check
-                    conditionPass = currentConditionPass;
-                }
+    void set(size_t row, string_view value) {
+        materialize();
+        if (encoded) {
+            uint32_t code = encode(value);
+            if (encoded) {
+                codes.set(row, code);
+                return;
             }
         }
-
-        // Only print the row if the condition passes (AND/OR logic)
-        if (conditionPass || hasPassedAnyCondition) {
-            for (const auto &colName: actualColumnsToPrint) {
-                printColumnValue(columns.at(colName)[rowIdx]);
-                fmt::print("{: <5}", ""); // Small gap after value
-            }
-            fmt::print("\n");
+        StringCell &cell = cells.at(row);
+        if (cell.isInline()) {
+            cell = store(value);
+            return;
         }
+        deadBytes += cell.length;
+        if (value.size() > stringInlineBytes && value.size() <= cell.length) {
+            copy(value.begin(), value.end(), heap.writable(cell.offset()));
+            copy_n(value.begin(), stringPrefixBytes, cell.bytes.begin());
+            cell.length = static_cast<uint32_t>(value.size());
+            deadBytes -= cell.length;
+        } else {
+            cell = store(value);
+        }
+        compactIfSparse();
     }
-}
 
+    void resize(size_t numRows, string_view value) {
+        materialize();
+        if (numRows == 0) {
+            clear();
+            return;
+        }
+        if (encoded) {
+            uint32_t code = numRows > codes.size() ? encode(value) : 0;
+            if (encoded) {
+                codes.resize(numRows, code);
+                return;
+            }
+        }
+        if (numRows < cells.size()) {
+            for (size_t row = numRows; row < cells.size(); ++row) {
+                if (!cells[row].isInline()) deadBytes += cells[row].length;
+            }
+            cells.resize(numRows, StringCell());
+            compactIfSparse();
+            return;
+        }
+        reserve(numRows);
+        while (cells.size() < numRows) cells.push_back(store(value));
+    }
 
-void processInsert(const vector<string> &query, Tables<int> &tables) {
-    if (query.size() < 7 || query[0] != "insert" || query[1] != "into") {
-        fmt::println("Invalid insert statement.");
-        return;
+    // Makes room for `numRows` cells (see ChunkedBuffer::reserve)
+    void reserve(size_t numRows) {
+        materialize();
+        if (encoded) {
+            codes.reserve(numRows);
+        } else {
+            cells.reserve(numRows);
+        }
     }
 
-    string tableName = query[2];
+    // Moves all cells of `other` to the end of this column; dictionary codes are translated once per distinct value.
+    // If the dictionary grows too large on the way, the column is decoded and the rows are appended as plain strings.
+    void append(StringColumn &&other) {
+        materialize();
+        if (encoded && other.isDictionaryEncoded()) {
+            vector<uint32_t> translated;
+            translated.reserve(other.dictionary.size());
+            for (const string &value: other.dictionary) {
+                translated.push_back(encode(value));
+                if (!encoded) break;
+            }
+            if (encoded) {
+                vector<uint32_t> batch;
+                for (size_t row = 0; row < other.codes.size(); row += batch.size()) {
+                    const uint32_t *otherCodes = other.codes.cells(row);
+                    batch.resize(min(other.codes.size() - row, zoneRows - row % zoneRows));
+                    for (uint32_t &code: batch) code = translated[*otherCodes++];
+                    codes.append(batch.data(), batch.size());
+                }
+                other.clear();
+                return;
+            }
+        }
+        size_t count = other.size();
+        reserve(size() + count);
+        if (!encoded && !other.isMapped() && !other.encoded) {
+            // Plain into plain: the heap pages move over, the long values only move by the old page count
+            uint64_t shift = heap.append(std::move(other.heap));
+            for (size_t row = 0; row < count; ++row) {
+                StringCell cell = other.cells[row];
+                if (!cell.isInline()) cell.setOffset(cell.offset() + shift);
+                cells.push_back(cell);
+            }
+            deadBytes += other.deadBytes;
+        } else {
+            for (size_t row = 0; row < count; ++row) push_back(other[row]);
+        }
+        other.clear();
+    }
 
-    if (!tables.tables.contains(tableName)) {
-        fmt::println("Table '{}' does not exist.", tableName);
-        return;
+    // A read-only copy; the codes, cells and heap pages stay shared until this column modifies them
+    StringColumn share() {
+        StringColumn copy = *this;
+        copy.codes = codes.share();
+        copy.cells = cells.share();
+        return copy;
     }
 
-    RowColumn<int> &table = tables.tables[tableName];
+private:
+    bool encoded = true;
+    ChunkedBuffer<uint32_t> codes;
+    vector<string> dictionary;
+    unordered_map<string, uint32_t, StringHash, equal_to<>> codeOf;
+
+    ChunkedBuffer<StringCell> cells;
+    StringHeap heap;
+    size_t deadBytes = 0;  // heap bytes no cell refers to any more
+
+    const uint64_t *mappedOffsets = nullptr;
+    const char *mappedBytes = nullptr;
+    size_t mappedSize = 0;
+    shared_ptr<const void> owner;
+
+    // Back to an empty dictionary-encoded column
+    void clear() {
+        encoded = true;
+        codes = ChunkedBuffer<uint32_t>();
+        dictionary = vector<string>();
+        codeOf = decltype(codeOf)();
+        cells = ChunkedBuffer<StringCell>();
+        heap = StringHeap();
+        deadBytes = 0;
+        mappedOffsets = nullptr;
+        mappedBytes = nullptr;
+        mappedSize = 0;
+        owner.reset();
+    }
 
-    // Parse column names inside parentheses
-    int startIdx = 2;
-    while (startIdx < query.size() && query[startIdx] != "(") ++startIdx;
-    int endIdx = startIdx + 1;
-    while (endIdx < query.size() && query[endIdx] != ")") ++endIdx;
+    // Copies the cells out of a mapped snapshot, choosing their form as if they had been appended
+    void materialize() {
+        if (!mappedOffsets) return;
+        StringColumn copy;
+        copy.reserve(mappedSize);
+        for (size_t row = 0; row < mappedSize; ++row) copy.push_back((*this)[row]);
+        *this = std::move(copy);
+    }
 
+    // The code of `value`, added to the dictionary if needed. Decodes the column instead if the dictionary has
+    // become too large; the caller then has to store the value as a plain string. A decoded column is left as it is.
+    uint32_t encode(string_view value) {
+        if (!encoded) return 0;
+        auto entry = codeOf.find(value);
+        if (entry != codeOf.end()) return entry->second;
+        uint32_t code = static_cast<uint32_t>(dictionary.size());
+        codeOf.emplace(value, code);
+        dictionary.emplace_back(value);
+
+        size_t rows = max(codes.size(), dictionaryMinRows);
+        if (dictionary.size() > dictionaryMaxEntries || dictionary.size() * 2 > rows) decode();
+        return code;
+    }
 
-    vector<string> columnNames(query.begin() + startIdx + 1, query.begin() + endIdx);
+    void decode() {
+        cells = ChunkedBuffer<StringCell>();
+        cells.reserve(codes.size());
+        for (size_t row = 0; row < codes.size(); ++row) cells.push_back(store(dictionary[codes[row]]));
+        encoded = false;
+        codes = ChunkedBuffer<uint32_t>();
+        dictionary = vector<string>();
+        codeOf = decltype(codeOf)();
+    }
 
-    int starIdxForValues = endIdx + 1;
-    while (starIdxForValues < query.size() && query[starIdxForValues] != "(") ++starIdxForValues;
-    int endIdxForValues = starIdxForValues + 1;
-    while (endIdxForValues < query.size() && query[endIdxForValues] != ")") ++endIdxForValues;
-    // Parse relative column values after key word Values
-    vector<string> columnValues(query.begin() + starIdxForValues + 1, query.begin() + endIdxForValues);
+    // A cell holding `value`; a long value is copied to the heap
+    StringCell store(string_view value) {
+        StringCell cell;
+        cell.length = static_cast<uint32_t>(value.size());
+        if (cell.isInline()) {
+            copy(value.begin(), value.end(), cell.bytes.begin());
+            return cell;
+        }
+        copy_n(value.begin(), stringPrefixBytes, cell.bytes.begin());
+        cell.setOffset(heap.add(value));
+        return cell;
+    }
 
-    if (columnNames.size() != columnValues.size()) {
-        fmt::println("{}", "there is mismatch in desired values to be inserted and predifined columns ");
-        return;
+    // Rewrites the heap in row order once most of it is garbage
+    void compactIfSparse() {
+        if (heap.size() < stringHeapCompactMinBytes || deadBytes * 2 <= heap.size()) return;
+        StringHeap live;
+        for (size_t row = 0; row < cells.size(); ++row) {
+            if (cells[row].isInline()) continue;
+            StringCell &cell = cells.at(row);
+            cell.setOffset(live.add({heap.at(cell.offset()), cell.length}));
+        }
+        heap = std::move(live);
+        deadBytes = 0;
     }
+};
+
+
+/* -- Int compression:
+ *
+ *     An int column is a list of sealed chunks, one per complete row group of `zoneRows`, followed by a tail of
+ *     plain cells. Each time the tail fills a row group it is sealed in the smallest of these encodings:
+ *
+ *         raw                 the plain cells
+ *         run-length          the value and end row of each run of equal cells
+ *         frame of reference  cell - minimum, bit-packed in as few bits as the chunk's range needs
+ *         delta               cell - (first + row * stride), with the chunk's average stride, bit-packed the same
+ *                             way: sorted or evenly spaced values such as ids need a few bits per cell, or none
+ *
+ *     Every encoding reads a single cell directly (run-length by a binary search over its runs), so row access,
+ *     key lookups and output work as before. Filters compare a run-length chunk once per run and unpack the other
+ *     encodings one batch at a time for the SIMD kernels. Updating a cell of a sealed chunk turns the chunk back
+ *     into raw cells. A column opened from a snapshot keeps its mapped cells in the tail until it is modified;
+ *     snapshots store the cells plainly.
+ */
+enum class IntEncoding : uint8_t {
+    Raw,
+    RunLength,
+    FrameOfReference,
+    Delta
+};
 
+template<unsigned Width, size_t Index>
+int32_t unpackCell(const char *group, int64_t prediction, int64_t stride) {
+    uint64_t word;
+    memcpy(&word, group + Index * Width / 8, sizeof(word));
+    uint64_t offset = (word >> (Index * Width % 8)) & ((uint64_t(1) << Width) - 1);
+    return static_cast<int32_t>(prediction + stride * int64_t(Index) + int64_t(offset));
+}
 
-    map<string, string> columnsToValue;
+template<unsigned Width, size_t... Index>
+void unpackGroup(const char *group, int64_t prediction, int64_t stride, int32_t *out, index_sequence<Index...>) {
+    ((out[Index] = unpackCell<Width, Index>(group, prediction, stride)), ...);
+}
 
-    for (int i = 0; i < columnNames.size(); i++) {
-        columnsToValue[columnNames[i]] = columnValues[i];
+// Unpacks `groups` groups of 8 offsets starting at `bytes`, adding each to the prediction of its row. A group takes
+// exactly `Width` bytes, so every shift is a constant and the loop body is fully unrolled.
+template<unsigned Width>
+void unpackGroups(const char *bytes, size_t groups, int64_t prediction, int64_t stride, int32_t *out) {
+    for (size_t group = 0; group < groups; ++group, bytes += Width, prediction += 8 * stride, out += 8) {
+        unpackGroup<Width>(bytes, prediction, stride, out, make_index_sequence<8>());
     }
+}
+
+using UnpackGroups = void (*)(const char *, size_t, int64_t, int64_t, int32_t *);
 
-    auto vectorOfPrimaryKeys = tables.primaryKeys[tableName];
+template<size_t... Width>
+constexpr array<UnpackGroups, sizeof...(Width)> unpackGroupsTable(index_sequence<Width...>) {
+    return {&unpackGroups<Width>...};
+}
+
+// Indexed by the offset width
+constexpr auto unpackGroupsByWidth = unpackGroupsTable(make_index_sequence<33>());
 
-    if (!vectorOfPrimaryKeys.empty()) {
-        // Build composite key for the new row
-        vector<string> newCompositeKey;
-        for (const auto &pk: vectorOfPrimaryKeys) {
-            newCompositeKey.push_back(columnsToValue[pk]);
+// One sealed row group of an int column
+class IntChunk {
+public:
+    IntEncoding encoding = IntEncoding::Raw;
+    vector<int32_t> cells;  // raw: every cell, run-length: the value of each run
+
+    // Encodes `count` cells in whichever encoding needs the fewest bytes; ties go to the one cheaper to filter
+    static IntChunk seal(const int32_t *values, size_t count) {
+        IntChunk chunk;
+        chunk.count = count;
+        if (count == 0) return chunk;
+
+        size_t runs = 1;
+        int64_t low = values[0], high = values[0];
+        for (size_t row = 1; row < count; ++row) {
+            runs += values[row] != values[row - 1];
+            low = min<int64_t>(low, values[row]);
+            high = max<int64_t>(high, values[row]);
         }
 
-        // Check against existing rows
-        int numRows = table.rowColumn.begin()->second.size(); // number of rows
-        for (int row = 0; row < numRows; ++row) {
-            vector<string> existingCompositeKey;
-            for (const auto &pk: vectorOfPrimaryKeys) {
-                existingCompositeKey.push_back(toString(table.rowColumn[pk][row]));
-            }
-            if (existingCompositeKey == newCompositeKey) {
-                fmt::println("Composite primary key constraint violated! Duplicate entry.");
-                return;
+        int64_t stride = count > 1 ? llround(double(int64_t(values[count - 1]) - values[0]) / double(count - 1)) : 0;
+        int64_t lowResidual = 0, highResidual = 0;
+        for (size_t row = 0; row < count; ++row) {
+            int64_t residual = values[row] - (values[0] + stride * int64_t(row));
+            lowResidual = min(lowResidual, residual);
+            highResidual = max(highResidual, residual);
+        }
+
+        // Packed encodings also carry their base and stride
+        auto packedBytes = [count](uint64_t range) {
+            return 2 * sizeof(int64_t) + (count * bit_width(range) + 63) / 64 * sizeof(uint64_t);
+        };
+        size_t rawBytes = count * sizeof(int32_t);
+        size_t runBytes = runs * (sizeof(int32_t) + sizeof(uint32_t));
+        size_t frameBytes = packedBytes(uint64_t(high - low));
+        size_t deltaBytes = packedBytes(uint64_t(highResidual - lowResidual));
+        size_t best = min({rawBytes, runBytes, frameBytes, deltaBytes});
+
+        if (rawBytes == best) {
+            chunk.cells.assign(values, values + count);
+        } else if (runBytes == best) {
+            chunk.encoding = IntEncoding::RunLength;
+            chunk.cells.reserve(runs);
+            chunk.runEnds.reserve(runs);
+            for (size_t row = 0; row < count; ++row) {
+                if (row > 0 && values[row] == values[row - 1]) continue;
+                if (row > 0) chunk.runEnds.push_back(static_cast<uint32_t>(row));
+                chunk.cells.push_back(values[row]);
             }
+            chunk.runEnds.push_back(static_cast<uint32_t>(count));
+        } else if (frameBytes == best) {
+            chunk.encoding = IntEncoding::FrameOfReference;
+            chunk.base = low;
+            chunk.pack(values, uint64_t(high - low));
+        } else if (deltaBytes == best) {
+            chunk.encoding = IntEncoding::Delta;
+            chunk.base = values[0] + lowResidual;
+            chunk.stride = stride;
+            chunk.pack(values, uint64_t(highResidual - lowResidual));
         }
+        return chunk;
     }
 
-    // --- Foreign key check ---
-    for (const auto &fk: tables.foreignKeys) {
-        if (fk.referencingTable != tableName) continue;
-
-        vector<string> referencingValues;
-        for (const auto &col: fk.referencingColumns) {
-            referencingValues.push_back(columnsToValue[col]);
+    size_t size() const { return count; }
+
+    int32_t operator[](size_t row) const {
+        switch (encoding) {
+            case IntEncoding::Raw:
+                return cells[row];
+            case IntEncoding::RunLength:
+                return cells[runOf(row)];
+            case IntEncoding::FrameOfReference:
+            case IntEncoding::Delta:
+                return static_cast<int32_t>(predict(row) + int64_t(unpack(row * width)));
         }
+        return 0;
+    }
 
-        const auto &refTable = tables.tables[fk.referencedTable];
-        int rowCount = refTable.rowColumn.begin()->second.size();
-        bool matchFound = false;
-
-        for (int row = 0; row < rowCount; ++row) {
-            vector<string> referencedValues;
-            for (const auto &refCol: fk.referencedColumns) {
-                referencedValues.push_back(toString(refTable.rowColumn.at(refCol)[row]));
-            }
-            if (referencingValues == referencedValues) {
-                matchFound = true;
-                break;
+    // Writes the cells [first, first + rows) to `out`
+    void decode(size_t first, size_t rows, int32_t *out) const {
+        switch (encoding) {
+            case IntEncoding::Raw:
+                copy_n(cells.begin() + static_cast<ptrdiff_t>(first), rows, out);
+                return;
+            case IntEncoding::RunLength:
+                forEachRun(first, rows, [&out](size_t, size_t runRows, int32_t value) {
+                    out = fill_n(out, runRows, value);
+                });
+                return;
+            case IntEncoding::FrameOfReference:
+            case IntEncoding::Delta: {
+                // Locals, as stores through `out` could otherwise alias the members and force reloads
+                const char *bytes = reinterpret_cast<const char *>(packed.data());
+                size_t bits = width, i = 0, bit = first * bits;
+                uint64_t mask = (uint64_t(1) << bits) - 1;
+                int64_t prediction = predict(first), step = stride;
+                if (first % 8 == 0 && bits < unpackGroupsByWidth.size()) {
+                    unpackGroupsByWidth[bits](bytes + bit / 8, rows / 8, prediction, step, out);
+                    i = rows / 8 * 8;
+                    bit += i * bits;
+                    prediction += step * int64_t(i);
+                }
+                for (; i < rows; ++i, bit += bits, prediction += step) {
+                    uint64_t word;
+                    memcpy(&word, bytes + bit / 8, sizeof(word));
+                    out[i] = static_cast<int32_t>(prediction + int64_t((word >> (bit % 8)) & mask));
+                }
+                return;
             }
         }
+    }
 
-        if (!matchFound) {
-            fmt::println("Foreign key constraint failed: referencing values not found in referenced table '{}'.",
-                         fk.referencedTable);
-            return;
+    // Calls `visit(firstRow, rows, value)` for the runs covering rows [first, first + rows) of a run-length chunk,
+    // clipped to that range
+    template<typename Visit>
+    void forEachRun(size_t first, size_t rows, Visit &&visit) const {
+        size_t end = first + rows;
+        for (size_t run = runOf(first), row = first; row < end; ++run) {
+            size_t runEnd = min<size_t>(runEnds[run], end);
+            visit(row, runEnd - row, cells[run]);
+            row = runEnd;
         }
     }
 
-    // ---- INSERT VALUES ----
-    for (auto &[colName, colValues]: table.rowColumn) {
-        if (!columnsToValue.contains(colName)) {
-            fmt::println("Column '{}' missing from insert statement.", colName);
-            return;
-        }
-        string valToInsert = columnsToValue[colName];
-        ColumnValue typedVal;
+    // Turns the chunk into raw cells
+    void unpackAll() {
+        if (encoding == IntEncoding::Raw) return;
+        vector<int32_t> values(count);
+        decode(0, count, values.data());
+        *this = IntChunk();
+        count = values.size();
+        cells = std::move(values);
+    }
 
-        if (holds_alternative<int>(colValues.front())) {
-            typedVal = stoi(valToInsert);
-        } else if (holds_alternative<float>(colValues.front())) {
-            typedVal = stof(valToInsert);
-        } else {
-            typedVal = valToInsert;
+private:
+    size_t count = 0;
+    uint8_t width = 0;         // bits per packed offset
+    int64_t base = 0;          // frame of reference: the minimum, delta: the prediction of row 0
+    int64_t stride = 0;        // delta: added to the prediction per row, frame of reference: 0
+    vector<uint32_t> runEnds;  // run-length: one past the last row of each run
+    vector<uint64_t> packed;   // frame of reference and delta: the offsets from the prediction, plus a padding word
+
+    size_t runOf(size_t row) const {
+        return static_cast<size_t>(upper_bound(runEnds.begin(), runEnds.end(), row) - runEnds.begin());
+    }
+
+    int64_t predict(size_t row) const { return base + stride * int64_t(row); }
+
+    void pack(const int32_t *values, uint64_t range) {
+        width = static_cast<uint8_t>(bit_width(range));
+        packed.assign((count * width + 63) / 64 + 1, 0);
+        for (size_t row = 0, bit = 0; row < count; ++row, bit += width) {
+            uint64_t offset = uint64_t(int64_t(values[row]) - (base + stride * int64_t(row)));
+            if (width == 0) continue;
+            packed[bit / 64] |= offset << (bit % 64);
+            if (bit % 64 + width > 64) packed[bit / 64 + 1] |= offset >> (64 - bit % 64);
         }
+    }
 
-        colValues.push_back(typedVal);
+    // The offset packed at bit position `bit`. A chunk only packs offsets narrower than its raw cells, so one
+    // unaligned load covers each, and the padding word keeps the load inside the buffer.
+    uint64_t unpack(size_t bit) const {
+        uint64_t word;
+        memcpy(&word, reinterpret_cast<const char *>(packed.data()) + bit / 8, sizeof(word));
+        return (word >> (bit % 8)) & ((uint64_t(1) << width) - 1);
     }
+};
 
-    fmt::println("Inserted into table '{}'", tableName);
-}
+// The cells of an int column: sealed chunks of `zoneRows` cells followed by a plain, possibly mapped tail
+class IntColumn {
+public:
+    size_t size() const { return sealedRows() + tail.size(); }
 
+    int32_t operator[](size_t row) const {
+        size_t chunk = row / zoneRows;
+        return chunk < chunks.size() ? (*chunks[chunk])[row % zoneRows] : tail[row - sealedRows()];
+    }
 
-auto defineNumberOfCreateStatements(vector<string> query) {
-    vector<vector<string>> result;
-    vector<string>::iterator beginRange;
-    vector<string>::iterator endRange;
-    bool constructionValid = false;
-    bool isCreateStatement = false;
+    // The sealed chunk holding `row`, or null if the row is in the tail
+    const IntChunk *chunkOf(size_t row) const {
+        size_t chunk = row / zoneRows;
+        return chunk < chunks.size() ? chunks[chunk].get() : nullptr;
+    }
 
-    for (auto i = query.begin(); i != query.end(); i++) {
+    // The cells [first, first + rows) of one row group: stored plainly, or decoded into `scratch`
+    const int32_t *cells(size_t first, size_t rows, int32_t *scratch) const {
+        const IntChunk *chunk = chunkOf(first);
+        if (!chunk) return tail.data() + (first - sealedRows());
+        if (chunk->encoding == IntEncoding::Raw) return chunk->cells.data() + first % zoneRows;
+        chunk->decode(first % zoneRows, rows, scratch);
+        return scratch;
+    }
 
-        if (*i == DBCommands::create) {
-            beginRange = i;
-            isCreateStatement = true;
+    // Writes the cells [first, first + rows) to `out`
+    void copyTo(size_t first, size_t rows, int32_t *out) const {
+        while (rows > 0) {
+            const IntChunk *chunk = chunkOf(first);
+            if (!chunk) {
+                copy_n(tail.data() + (first - sealedRows()), rows, out);
+                return;
+            }
+            size_t count = min(rows, zoneRows - first % zoneRows);
+            chunk->decode(first % zoneRows, count, out);
+            first += count;
+            rows -= count;
+            out += count;
         }
+    }
 
-        if (*i == "primary" && isCreateStatement) {
-            if (*(i + 1) == "key") {
-                if (*(i + 2) == "(") {
-                    i = i + 4;
-                    continue;
-                }
-                i = i + 1;
+    void map(const int32_t *cells, size_t count, shared_ptr<const void> file) {
+        chunks = vector<shared_ptr<IntChunk>>();
+        tail.map(cells, count, std::move(file));
+    }
+
+    void assign(const int32_t *cells, size_t count) {
+        chunks = vector<shared_ptr<IntChunk>>();
+        tail = ColumnBuffer<int32_t>();
+        append(cells, count);
+    }
+
+    void push_back(int32_t value) {
+        tail.push_back(value);
+        seal();
+    }
+
+    void append(const int32_t *cells, size_t count) {
+        while (count > 0) {
+            size_t rows = tail.size() < zoneRows ? min(count, zoneRows - tail.size()) : count;
+            tail.own().insert(tail.own().end(), cells, cells + rows);
+            seal();
+            cells += rows;
+            count -= rows;
+        }
+    }
+
+    // Moves all cells of `other` to the end of this column; sealed chunks are taken over as they are when this
+    // column ends on a row group boundary
+    void append(IntColumn &&other) {
+        for (shared_ptr<IntChunk> &chunk: other.chunks) {
+            if (tail.empty()) {
+                chunks.push_back(std::move(chunk));
                 continue;
             }
+            vector<int32_t> cells(chunk->size());
+            chunk->decode(0, cells.size(), cells.data());
+            append(cells.data(), cells.size());
         }
+        append(other.tail.data(), other.tail.size());
+        other = IntColumn();
+    }
 
-        if (*i == ")" && isCreateStatement) {
-            endRange = i + 1;
-            constructionValid = true;
+    void set(size_t row, int32_t value) {
+        size_t chunk = row / zoneRows;
+        if (chunk >= chunks.size()) {
+            tail.set(row - sealedRows(), value);
+            return;
         }
+        shared_ptr<IntChunk> &sealed = chunks[chunk];
+        if (sealed.use_count() > 1) sealed = make_shared<IntChunk>(*sealed);  // still read by a checkpoint
+        sealed->unpackAll();
+        sealed->cells[row % zoneRows] = value;
+    }
 
-        if (constructionValid) {
-            auto temp = vector<string>(beginRange, endRange);
-            result.push_back(temp);
-            constructionValid = false;
-            isCreateStatement = false;
+    // Grows or shrinks the column to `numRows`, new cells get `value`. Chunks past the new end are dropped and only a
+    // chunk that it cuts is decoded; new cells are sealed a row group at a time, so `fill` never holds the column
+    // uncompressed.
+    void resize(size_t numRows, int32_t value) {
+        if (numRows < sealedRows()) {
+            chunks.resize((numRows + zoneRows - 1) / zoneRows);
+            tail = ColumnBuffer<int32_t>();
+            if (numRows % zoneRows != 0) unsealFrom(numRows / zoneRows);
         }
+        if (numRows < size()) tail.own().resize(numRows - sealedRows());
+        if (numRows <= size()) return;
+        vector<int32_t> cells(min(numRows - size(), zoneRows), value);
+        while (size() < numRows) append(cells.data(), min(cells.size(), numRows - size()));
+    }
 
+    // Makes room for `numRows` cells; only the tail holds plain cells, so at most a row group of them is reserved
+    void reserve(size_t numRows) {
+        if (numRows / zoneRows > chunks.capacity()) chunks.reserve(max(numRows / zoneRows, chunks.capacity() * 2));
+        size_t tailRows = min(numRows - min(numRows, sealedRows()), zoneRows);
+        if (tailRows > tail.size()) tail.own().reserve(tailRows);
     }
 
-    return result;
+    // A read-only copy; the chunks are shared, `set` copies one before it modifies it while the copy holds it
+    IntColumn share() {
+        IntColumn copy;
+        copy.chunks = chunks;
+        copy.tail = tail.share();
+        return copy;
+    }
 
-}
+private:
+    vector<shared_ptr<IntChunk>> chunks;
+    ColumnBuffer<int32_t> tail;
 
-auto defineNumberOfUpdateStatements(vector<string> query) {
+    size_t sealedRows() const { return chunks.size() * zoneRows; }
 
+    // Seals every complete row group in the tail
+    void seal() {
+        if (tail.size() < zoneRows) return;
+        vector<int32_t> &cells = tail.own();
+        size_t sealed = 0;
+        for (; sealed + zoneRows <= cells.size(); sealed += zoneRows) {
+            chunks.push_back(make_shared<IntChunk>(IntChunk::seal(cells.data() + sealed, zoneRows)));
+        }
+        cells.erase(cells.begin(), cells.begin() + static_cast<ptrdiff_t>(sealed));
+        if (cells.capacity() > 2 * zoneRows) cells.shrink_to_fit();
+    }
 
-}
+    // Moves the chunks from `first` on back into the tail as plain cells
+    void unsealFrom(size_t first) {
+        vector<int32_t> cells(sealedRows() - first * zoneRows + tail.size());
+        copyTo(first * zoneRows, cells.size(), cells.data());
+        chunks.resize(first);
+        tail = ColumnBuffer<int32_t>();
+        tail.own() = std::move(cells);
+    }
+};
 
 
-auto processUpdate(const vector<string> &query, Tables<int> &tables) {
-    bool isWherePresent = false;
-    auto tableName = query[1];
-    WherePattern pattern;
-    if (query[0] != DBCommands::update || query.size() < 3 || query[2] != "set") {
-        fmt::println("invalid update Format");
-        return;
+/* One column of a table. Only the buffer matching `type` is used: float cells live in contiguous row groups
+ * and int cells in batches that are plain or unpacked into one, so scans and comparisons work on raw values
+ * without dispatching per cell.
+ */
+class Column {
+public:
+    ColumnType type = ColumnType::Int;
+    IntColumn ints;
+    ChunkedBuffer<float> floats;
+    StringColumn strings;
+
+    Column() = default;
+
+    explicit Column(ColumnType columnType) : type(columnType) {}
+
+    size_t size() const {
+        switch (type) {
+            case ColumnType::Int:
+                return ints.size();
+            case ColumnType::Float:
+                return floats.size();
+            case ColumnType::String:
+                return strings.size();
+        }
+        return 0;
     }
 
-    if (!tables.tables.contains(tableName)) {
-        fmt::println("no such table exist");
+    void append(const ColumnValue &value) {
+        switch (type) {
+            case ColumnType::Int:
+                ints.push_back(get<int>(value));
+                break;
+            case ColumnType::Float:
+                floats.push_back(get<float>(value));
+                break;
+            case ColumnType::String:
+                strings.push_back(get<string>(value));
+                break;
+        }
     }
 
-    int i = 3;
-    map<string, string> columnAndValue;
-    for (i; i < query.size(); i++) {
-        if (query[i] == DBCommands::where) {
-            isWherePresent = true;
-            pattern = processWhereStatement(query);
-            break;
-        }
-        if (query[i] == "=") {
-            columnAndValue[query[i - 1]] = query[i + 1];
+    // Parses `text` as a value of the column type and appends it; nothing is appended if the text is invalid
+    bool appendText(string_view text) {
+        const char *end = text.data() + text.size();
+        switch (type) {
+            case ColumnType::Int: {
+                int32_t number = 0;
+                auto parsed = from_chars(text.data(), end, number);
+                if (parsed.ec != errc() || parsed.ptr != end) return false;
+                ints.push_back(number);
+                return true;
+            }
+            case ColumnType::Float: {
+                float number = 0.0f;
+                auto parsed = from_chars(text.data(), end, number);
+                if (parsed.ec != errc() || parsed.ptr != end) return false;
+                floats.push_back(number);
+                return true;
+            }
+            case ColumnType::String:
+                strings.push_back(text);
+                return true;
         }
+        return false;
     }
 
-    for (const auto &item: columnAndValue) {
-        if (!tables.tables[tableName].rowColumn.contains(item.first)) {
-            fmt::println("no such column in table {} ", tableName);
+    // Moves all cells of `other`, a column of the same type, to the end of this column
+    void appendColumn(Column &&other) {
+        switch (type) {
+            case ColumnType::Int:
+                ints.append(std::move(other.ints));
+                break;
+            case ColumnType::Float:
+                floats.append(std::move(other.floats));
+                break;
+            case ColumnType::String:
+                strings.append(std::move(other.strings));
+                break;
         }
+        other = Column(type);
     }
 
+    // Makes room for `numRows` cells, so repeated batches stay amortised O(1) per row
+    void reserve(size_t numRows) {
+        switch (type) {
+            case ColumnType::Int:
+                ints.reserve(numRows);
+                break;
+            case ColumnType::Float:
+                floats.reserve(numRows);
+                break;
+            case ColumnType::String:
+                strings.reserve(numRows);
+                break;
+        }
+    }
 
-    if (!isWherePresent) {
-        for (const auto &item: columnAndValue) {
-            vector<ColumnValue> newValues(tables.tables[tableName].rowColumn[item.first].size(), item.second);
-            tables.tables[tableName].rowColumn[item.first] = newValues;
+    void set(size_t row, const ColumnValue &value) {
+        switch (type) {
+            case ColumnType::Int:
+                ints.set(row, get<int>(value));
+                break;
+            case ColumnType::Float:
+                floats.set(row, get<float>(value));
+                break;
+            case ColumnType::String:
+                strings.set(row, get<string>(value));
+                break;
         }
-    } else {
-        RowColumn<int> &table = tables.tables[tableName];
-        int numRows = table.rowColumn.begin()->second.size();
-
-        for (int rowIdx = 0; rowIdx < numRows; ++rowIdx) {
-            bool conditionPass = true;
-            bool hasPassedAnyCondition = false;
-
-            if (isWherePresent) {
-                for (size_t condIdx = 0; condIdx < pattern.conditions.size(); ++condIdx) {
-                    const auto &cond = pattern.conditions[condIdx];
-                    const auto &column = table.rowColumn.at(cond.column);
-                    const auto &cell = column[rowIdx];
-                    bool currentConditionPass = false;
-
-                    if (std::holds_alternative<int>(cell)) {
-                        int value = std::get<int>(cell);
-                        int target = std::stoi(cond.value);
-                        if (cond.operation == ">") currentConditionPass = value > target;
-                        else if (cond.operation == "<") currentConditionPass = value < target;
-                        else if (cond.operation == ">=") currentConditionPass = value >= target;
-                        else if (cond.operation == "<=") currentConditionPass = value <= target;
-                        else if (cond.operation == "=") currentConditionPass = value == target;
-                    } else if (std::holds_alternative<std::string>(cell)) {
-                        const string &value = std::get<std::string>(cell);
-                        if (cond.operation == "=") currentConditionPass = value == cond.value;
-                        else if (cond.operation == ">") currentConditionPass = value > cond.value;
-                        else if (cond.operation == "<") currentConditionPass = value < cond.value;
-                        else if (cond.operation == ">=") currentConditionPass = value >= cond.value;
-                        else if (cond.operation == "<=") currentConditionPass = value <= cond.value;
-                    }
-
-                    if (condIdx > 0) {
-                        const string &logic = pattern.logicalOperators[condIdx - 1];
-                        if (logic == "and") {
-                            conditionPass = conditionPass && currentConditionPass;
-                        } else if (logic == "or") {
-                            conditionPass = conditionPass || currentConditionPass;
-                        }
-                    } else {
-                        conditionPass = currentConditionPass;
-                    }
-                }
-            }
+        if (row / zoneRows < zones.size()) zones[row / zoneRows].widen(zoneKey(row));
+    }
 
-            if (!isWherePresent || conditionPass) {
-                for (const auto &[col, strVal]: columnAndValue) {
-                    auto &column = table.rowColumn[col];
-                    if (std::holds_alternative<int>(column[rowIdx])) {
-                        column[rowIdx] = std::stoi(strVal);
-                    } else if (std::holds_alternative<float>(column[rowIdx])) {
-                        column[rowIdx] = std::stof(strVal);
-                    } else {
-                        column[rowIdx] = strVal;
-                    }
-                }
-            }
+    // Grows or shrinks the column to `numRows`, new cells get `value`
+    void resize(size_t numRows, const ColumnValue &value) {
+        zones.resize(min(zones.size(), numRows / zoneRows));
+        switch (type) {
+            case ColumnType::Int:
+                ints.resize(numRows, get<int>(value));
+                break;
+            case ColumnType::Float:
+                floats.resize(numRows, get<float>(value));
+                break;
+            case ColumnType::String:
+                strings.resize(numRows, get<string>(value));
+                break;
         }
+    }
 
+    // Sets every cell to `value`; an int column drops its chunks without decoding them (see IntColumn::resize)
+    void fill(const ColumnValue &value) {
+        size_t numRows = size();
+        resize(0, value);
+        resize(numRows, value);
     }
 
-}
+    ColumnValue value(size_t row) const {
+        switch (type) {
+            case ColumnType::Int:
+                return ints[row];
+            case ColumnType::Float:
+                return floats[row];
+            case ColumnType::String:
+                return string(strings[row]);
+        }
+        return {};
+    }
 
-void processAdd(const vector<string> &query, Tables<int> &tables, const string &tableName) {
-    auto newColumnName = query[4];
-    auto &columns = tables.tables[tableName].rowColumn;
-    auto type = query[5];
-    ColumnValue defaultType;
+    bool cellEquals(size_t row, const ColumnValue &value) const {
+        switch (type) {
+            case ColumnType::Int:
+                return ints[row] == get<int>(value);
+            case ColumnType::Float:
+                return floats[row] == get<float>(value);
+            case ColumnType::String:
+                return strings[row] == get<string>(value);
+        }
+        return false;
+    }
 
-    if (columns.contains(newColumnName)) {
-        fmt::println("column {} already existst in table {} ", newColumnName, tableName);
-        return;
+    // Compares with a cell of another column of the same type
+    bool cellEquals(size_t row, const Column &other, size_t otherRow) const {
+        switch (type) {
+            case ColumnType::Int:
+                return ints[row] == other.ints[otherRow];
+            case ColumnType::Float:
+                return floats[row] == other.floats[otherRow];
+            case ColumnType::String:
+                return strings[row] == other.strings[otherRow];
+        }
+        return false;
     }
 
-    if (type == "int") {
-        // Store a vector of ColumnValue with a default value (int)
-        defaultType = {ColumnValue(0)};  // Correct for vector of ColumnValue
-    } else if (type == "string") {
-        // Store a vector of ColumnValue with a default value (empty string)
-        defaultType = {ColumnValue("null")};  // Correct for vector of ColumnValue
-    } else if (type == "float") {
-        // Store a vector of ColumnValue with a default value (float)
-        defaultType = {ColumnValue(0.0f)};  // Correct for vector of ColumnValue
+    bool cellsEqual(size_t lhs, size_t rhs) const {
+        switch (type) {
+            case ColumnType::Int:
+                return ints[lhs] == ints[rhs];
+            case ColumnType::Float:
+                return floats[lhs] == floats[rhs];
+            case ColumnType::String:
+                return strings.cellsEqual(lhs, rhs);
+        }
+        return false;
     }
 
-    // we need to know the size of one of the primary key columns to populate the table with default values
-    auto primaryKeyColumn = tables.primaryKeys[tableName][0];
-    auto size = columns[primaryKeyColumn].size();
+    // Must agree with hashColumnValue for the same value
+    uint64_t hashCell(size_t row) const {
+        switch (type) {
+            case ColumnType::Int:
+                return hash<int>{}(ints[row]);
+            case ColumnType::Float:
+                return hash<float>{}(floats[row]);
+            case ColumnType::String:
+                return hash<string_view>{}(strings[row]);
+        }
+        return 0;
+    }
 
-    vector<ColumnValue> defaultColumnValues(size, defaultType);
+    string formatCell(size_t row) const {
+        switch (type) {
+            case ColumnType::Int:
+                return fmt::format("{}", ints[row]);
+            case ColumnType::Float:
+                return fmt::format("{}", floats[row]);
+            case ColumnType::String:
+                return string(strings[row]);
+        }
+        return {};
+    }
 
-    columns[newColumnName] = defaultColumnValues;
+    // A read-only copy for a checkpoint; the cells stay shared until this column modifies them
+    Column share() {
+        Column copy(type);
+        switch (type) {
+            case ColumnType::Int:
+                copy.ints = ints.share();
+                break;
+            case ColumnType::Float:
+                copy.floats = floats.share();
+                break;
+            case ColumnType::String:
+                copy.strings = strings.share();
+                break;
+        }
+        copy.zones = zones;
+        return copy;
+    }
 
-}
+    // The zone of row group `group`, which must be complete; built on first use
+    const Zone &zone(size_t group) const {
+        while (zones.size() <= group) {
+            Zone &built = zones.emplace_back();
+            for (size_t row = (zones.size() - 1) * zoneRows, end = row + zoneRows; row < end; ++row) {
+                built.widen(zoneKey(row));
+            }
+        }
+        return zones[group];
+    }
 
-void processForeignKey(const vector<string> &query, Tables<int> &tables, const string &tableName) {
-    vector<string> referencingColumns;
-    vector<string> referencedColumns;
+private:
+    mutable vector<Zone> zones;  // of the first complete row groups
+
+    double zoneKey(size_t row) const {
+        switch (type) {
+            case ColumnType::Int:
+                return ints[row];
+            case ColumnType::Float:
+                return floats[row];
+            case ColumnType::String:
+                return strings.prefixKey(row);
+        }
+        return 0.0;
+    }
+};
 
 
+struct ForeignKey {
+    string referencingTable;
+    vector<std::string> referencingColumns;
+
     string referencedTable;
+    vector<std::string> referencedColumns;
+};
 
-    bool inReferencingColumns = false;
-    bool inReferencedColumns = false;
 
-    for (size_t i = 0; i < query.size(); ++i) {
-        if (query[i] == "foreign" && i + 1 < query.size() && query[i + 1] == "key") {
-            inReferencingColumns = true;
-            i += 2;
-            continue;
+struct ColumnSchema {
+    string name;
+    ColumnType type;
+    size_t ordinal;
+    bool isPrimaryKey = false;
+};
+
+
+/* Catalog entry of one table: column names, types and ordinal positions, plus the primary key as ordinals.
+ * Statements resolve names to ordinals once; per-row work then only indexes `RowColumn::columns`.
+ */
+class TableSchema {
+public:
+    vector<ColumnSchema> columns;                                  // in ordinal (declaration) order
+    unordered_map<string, size_t, StringHash, equal_to<>> ordinals;
+    vector<size_t> primaryKeyOrdinals;                             // in `Tables::primaryKeys` order
+
+    bool contains(string_view name) const { return ordinals.contains(name); }
+
+    const ColumnSchema *find(string_view name) const {
+        auto it = ordinals.find(name);
+        return it == ordinals.end() ? nullptr : &columns[it->second];
+    }
+
+    size_t add(const string &name, ColumnType type) {
+        size_t ordinal = columns.size();
+        columns.push_back(ColumnSchema(name, type, ordinal));
+        ordinals[name] = ordinal;
+        return ordinal;
+    }
+
+    void erase(string_view name) {
+        auto it = ordinals.find(name);
+        if (it == ordinals.end()) return;
+        columns.erase(columns.begin() + it->second);
+        renumber();
+    }
+
+    void setPrimaryKey(const vector<string> &names) {
+        primaryKeyOrdinals.clear();
+        for (auto &column: columns) column.isPrimaryKey = false;
+        for (const auto &name: names) {
+            size_t ordinal = ordinals.at(name);
+            primaryKeyOrdinals.push_back(ordinal);
+            columns[ordinal].isPrimaryKey = true;
         }
+    }
 
-        if (inReferencingColumns && query[i] == "(") continue;
-        if (inReferencingColumns && query[i] == ")") {
-            inReferencingColumns = false;
-            continue;
+private:
+    void renumber() {
+        ordinals.clear();
+        vector<string> primaryKey;
+        for (size_t ordinal : primaryKeyOrdinals) primaryKey.push_back(columns[ordinal].name);
+        for (size_t i = 0; i < columns.size(); ++i) {
+            columns[i].ordinal = i;
+            ordinals[columns[i].name] = i;
         }
-        if (inReferencingColumns) {
-            referencingColumns.push_back(query[i]);
-            continue;
+        primaryKeyOrdinals.clear();
+        for (const auto &name: primaryKey) {
+            if (ordinals.contains(name)) primaryKeyOrdinals.push_back(ordinals[name]);
         }
+    }
+};
 
-        if (query[i] == "references" && i + 1 < query.size()) {
-            referencedTable = query[++i];
-            inReferencedColumns = true;
-            continue;
+
+/* A table: its schema and one typed column per schema entry. Storage starts empty, every column
+ * always holds exactly `numRows` cells.
+ */
+template<typename T>
+class RowColumn {
+public:
+    TableSchema schema;
+    vector<Column> columns;  // indexed by ColumnSchema::ordinal
+    size_t numRows = 0;
+
+    Column *column(string_view name) {
+        auto *entry = schema.find(name);
+        return entry ? &columns[entry->ordinal] : nullptr;
+    }
+
+    const Column *column(string_view name) const {
+        auto *entry = schema.find(name);
+        return entry ? &columns[entry->ordinal] : nullptr;
+    }
+
+    void addColumn(const string &name, ColumnType type, const ColumnValue &fillValue) {
+        schema.add(name, type);
+        columns.emplace_back(type);
+        columns.back().resize(numRows, fillValue);
+    }
+
+    void dropColumn(string_view name) {
+        auto *entry = schema.find(name);
+        if (!entry) return;
+        columns.erase(columns.begin() + entry->ordinal);
+        schema.erase(name);
+    }
+
+    // A read-only copy for a checkpoint, see Column::share
+    RowColumn share() {
+        RowColumn copy;
+        copy.schema = schema;
+        copy.numRows = numRows;
+        copy.columns.reserve(columns.size());
+        for (Column &column: columns) copy.columns.push_back(column.share());
+        return copy;
+    }
+};
+
+void appendCell(fmt::memory_buffer &buffer, const Column &column, size_t row) {
+    switch (column.type) {
+        case ColumnType::Int:
+            fmt::format_to(back_inserter(buffer), "{}", column.ints[row]);
+            break;
+        case ColumnType::Float:
+            fmt::format_to(back_inserter(buffer), "{}", column.floats[row]);
+            break;
+        case ColumnType::String: {
+            string_view value = column.strings[row];
+            buffer.append(value.data(), value.data() + value.size());
+            break;
         }
+    }
+}
+
+
+// How query results are rendered; chosen with `set output <mode>`
+enum class OutputMode : uint8_t {
+    Pretty,
+    Csv,
+    Tsv,
+    Quiet   // only count the rows, for benchmarking
+};
+
+
+/* Renders result rows into a reusable memory buffer and writes it to `out` in large chunks, so producing a row
+ * never goes through stdio per value.
+ */
+class ResultWriter {
+public:
+    static constexpr size_t flushThreshold = 256 * 1024;
+
+    ResultWriter(fmt::memory_buffer &buffer, OutputMode mode, FILE *out = stdout)
+            : buffer(buffer), mode(mode), out(out) {
+        buffer.clear();
+    }
+
+    ~ResultWriter() { flush(); }
+
+    void header(const vector<string> &names) {
+        switch (mode) {
+            case OutputMode::Pretty:
+                for (const auto &name: names) {
+                    fmt::format_to(back_inserter(buffer), "| {:15} ", name);
+                }
+                append("|\n");
+                for (size_t i = 0; i < names.size(); ++i) {
+                    fmt::format_to(back_inserter(buffer), "|{:-^17}", "");
+                }
+                append("|\n");
+                break;
+            case OutputMode::Csv:
+            case OutputMode::Tsv:
+                for (size_t i = 0; i < names.size(); ++i) {
+                    if (i > 0) append(separator());
+                    appendField(names[i]);
+                }
+                append("\n");
+                break;
+            case OutputMode::Quiet:
+                break;
+        }
+    }
+
+    void row(const vector<const Column *> &columns, size_t rowIdx) {
+        ++rowCount;
+        if (mode == OutputMode::Quiet) return;
+
+        for (size_t i = 0; i < columns.size(); ++i) {
+            if (mode == OutputMode::Pretty) {
+                appendCell(buffer, *columns[i], rowIdx);
+                append("      ");  // Small gap after value
+            } else {
+                if (i > 0) append(separator());
+                if (mode == OutputMode::Csv && columns[i]->type == ColumnType::String) {
+                    appendField(columns[i]->strings[rowIdx]);
+                } else {
+                    appendCell(buffer, *columns[i], rowIdx);
+                }
+            }
+        }
+        append("\n");
+        if (buffer.size() >= flushThreshold) flush();
+    }
+
+    // Ends the result; quiet mode reports the number of rows instead of printing them
+    void finish() {
+        if (mode == OutputMode::Quiet) {
+            fmt::format_to(back_inserter(buffer), "{} rows\n", rowCount);
+        }
+        flush();
+    }
+
+    void flush() {
+        if (buffer.size() == 0) return;
+        fwrite(buffer.data(), 1, buffer.size(), out);
+        buffer.clear();
+    }
+
+    size_t rows() const { return rowCount; }
+
+private:
+    fmt::memory_buffer &buffer;
+    OutputMode mode;
+    FILE *out;
+    size_t rowCount = 0;
+
+    string_view separator() const { return mode == OutputMode::Tsv ? "\t" : ","; }
+
+    void append(string_view text) { buffer.append(text.data(), text.data() + text.size()); }
+
+    // CSV fields containing a separator, quote or line break are quoted, quotes are doubled
+    void appendField(string_view value) {
+        if (mode != OutputMode::Csv || value.find_first_of(",\"\r\n") == string_view::npos) {
+            append(value);
+            return;
+        }
+        append("\"");
+        for (char c: value) {
+            if (c == '"') append("\"");
+            buffer.push_back(c);
+        }
+        append("\"");
+    }
+};
+
+
+using KeyColumns = vector<const Column *>;
+
+
+/* Open-addressing hash index over the (possibly composite) primary key of one table.
+ *
+ * Slots only store the cached hash and the row number; key values are compared against the column
+ * data itself, so probing never copies or stringifies a key. Linear probing, table size is a power of two
+ * and is kept at most half full.
+ */
+class PrimaryKeyIndex {
+public:
+    static constexpr uint32_t emptySlot = UINT32_MAX;
+
+    struct Slot {
+        uint64_t hash = 0;
+        uint32_t row = emptySlot;
+        uint32_t reserved = 0;  // keeps the padding defined, slots are written to snapshots as they are
+    };
+
+    ChunkedBuffer<Slot> slots;  // may point into an opened snapshot until the first insert or erase
+    size_t count = 0;
+
+    // `keyColumns` are the primary key columns in `Tables::primaryKeys` order, `key` the typed values to look for
+    bool contains(const KeyColumns &keyColumns, const vector<ColumnValue> &key) const {
+        return findRow(keyColumns, key, hashKey(key)) != emptySlot;
+    }
+
+    uint32_t findRow(const KeyColumns &keyColumns, const vector<ColumnValue> &key,
+                     uint64_t keyHash) const {
+        if (slots.empty()) return emptySlot;
+
+        size_t mask = slots.size() - 1;
+        for (size_t pos = keyHash & mask;; pos = (pos + 1) & mask) {
+            const Slot &slot = slots[pos];
+            if (slot.row == emptySlot) return emptySlot;
+            if (slot.hash == keyHash && rowMatches(keyColumns, slot.row, key)) return slot.row;
+        }
+    }
+
+    // Looks up the key stored in `probeRow` of `probeColumns`, e.g. the referencing columns of a foreign key;
+    // the probe columns must have the types of `keyColumns`
+    uint32_t findRow(const KeyColumns &keyColumns, const KeyColumns &probeColumns, uint32_t probeRow) const {
+        if (slots.empty()) return emptySlot;
+
+        uint64_t probeHash = hashRow(probeColumns, probeRow);
+        size_t mask = slots.size() - 1;
+        for (size_t pos = probeHash & mask;; pos = (pos + 1) & mask) {
+            const Slot &slot = slots[pos];
+            if (slot.row == emptySlot) return emptySlot;
+            if (slot.hash == probeHash && rowMatches(keyColumns, slot.row, probeColumns, probeRow)) return slot.row;
+        }
+    }
+
+    // Sizes the table for `numKeys` more keys so a batch insert does not rehash on the way
+    void reserve(size_t numKeys) {
+        size_t size = slots.empty() ? 16 : slots.size();
+        while ((count + numKeys) * 2 > size) size *= 2;
+        if (size != slots.size()) grow(size);
+    }
+
+    // Registers an already stored row; returns false if a row with the same key is present
+    bool insert(const KeyColumns &keyColumns, uint32_t row) {
+        if ((count + 1) * 2 > slots.size()) {
+            grow(slots.empty() ? 16 : slots.size() * 2);
+        }
+
+        uint64_t rowHash = hashRow(keyColumns, row);
+        size_t mask = slots.size() - 1;
+        for (size_t pos = rowHash & mask;; pos = (pos + 1) & mask) {
+            const Slot &slot = slots[pos];
+            if (slot.row == emptySlot) {
+                slots.set(pos, Slot(rowHash, row));
+                ++count;
+                return true;
+            }
+            if (slot.hash == rowHash && rowsMatch(keyColumns, slot.row, row)) return false;
+        }
+    }
+
+    // Removes a row registered by `insert` while its cells are still stored. Backward-shift deletion moves the
+    // following entries of the cluster up, so no tombstones are needed.
+    void erase(const KeyColumns &keyColumns, uint32_t row) {
+        if (slots.empty()) return;
+
+        size_t mask = slots.size() - 1;
+        size_t pos = hashRow(keyColumns, row) & mask;
+        while (slots[pos].row != row) {
+            if (slots[pos].row == emptySlot) return;
+            pos = (pos + 1) & mask;
+        }
+
+        for (size_t next = (pos + 1) & mask; slots[next].row != emptySlot; next = (next + 1) & mask) {
+            size_t home = slots[next].hash & mask;
+            if (((next - home) & mask) >= ((next - pos) & mask)) {
+                slots.set(pos, slots[next]);
+                pos = next;
+            }
+        }
+        slots.set(pos, Slot());
+        --count;
+    }
+
+    // Re-indexes rows [firstRow, numRows); returns false if the data contains duplicate keys
+    bool rebuild(const KeyColumns &keyColumns, size_t firstRow, size_t numRows) {
+        slots = ChunkedBuffer<Slot>();
+        count = 0;
+        bool unique = true;
+        for (size_t row = firstRow; row < numRows; ++row) {
+            unique = insert(keyColumns, static_cast<uint32_t>(row)) && unique;
+        }
+        return unique;
+    }
+
+    // A read-only copy for a checkpoint; the slots stay shared until this index modifies their row group
+    PrimaryKeyIndex share() {
+        PrimaryKeyIndex copy;
+        copy.slots = slots.share();
+        copy.count = count;
+        return copy;
+    }
+
+    static uint64_t hashKey(const vector<ColumnValue> &key) {
+        uint64_t result = 0;
+        for (const auto &value: key) {
+            result = combineHash(result, hashColumnValue(value));
+        }
+        return result;
+    }
+
+private:
+    static uint64_t hashRow(const KeyColumns &keyColumns, uint32_t row) {
+        uint64_t result = 0;
+        for (const auto *column: keyColumns) {
+            result = combineHash(result, column->hashCell(row));
+        }
+        return result;
+    }
+
+    static bool rowMatches(const KeyColumns &keyColumns, uint32_t row,
+                           const vector<ColumnValue> &key) {
+        for (size_t i = 0; i < keyColumns.size(); ++i) {
+            if (!keyColumns[i]->cellEquals(row, key[i])) return false;
+        }
+        return true;
+    }
+
+    static bool rowMatches(const KeyColumns &keyColumns, uint32_t row, const KeyColumns &probeColumns,
+                           uint32_t probeRow) {
+        for (size_t i = 0; i < keyColumns.size(); ++i) {
+            if (!keyColumns[i]->cellEquals(row, *probeColumns[i], probeRow)) return false;
+        }
+        return true;
+    }
+
+    static bool rowsMatch(const KeyColumns &keyColumns, uint32_t lhs, uint32_t rhs) {
+        for (const auto *column: keyColumns) {
+            if (!column->cellsEqual(lhs, rhs)) return false;
+        }
+        return true;
+    }
+
+    void grow(size_t newSize) {
+        vector<Slot> table(newSize);
+        size_t mask = newSize - 1;
+        for (size_t i = 0; i < slots.size(); ++i) {
+            const Slot &slot = slots[i];
+            if (slot.row == emptySlot) continue;
+            size_t pos = slot.hash & mask;
+            while (table[pos].row != emptySlot) pos = (pos + 1) & mask;
+            table[pos] = slot;
+        }
+        slots.assign(table.data(), table.size());
+    }
+};
+
+class WriteAheadLog;
+class CheckpointJob;
+
+// A table as stored by an earlier snapshot file of a data directory; see processCheckpoint
+struct SnapshotTableLocation {
+    string file;   // name of the file inside the directory
+    string entry;  // the catalog entry of the table, which locates its blocks in that file
+};
+
+using SnapshotTables = map<string, SnapshotTableLocation>;
+
+template<typename T>
+class Tables {
+public:
+    map<string, RowColumn<T>> tables;
+    map<string, vector<string>> primaryKeys;
+    map<string, PrimaryKeyIndex> primaryKeyIndexes;
+    vector<ForeignKey> foreignKeys;
+
+    string savingPath;
+
+    uint64_t changes = 0;                  // bumped by every statement that modified the catalog or the rows
+    string dataDirectory;                  // set when the program was started on a data directory
+    shared_ptr<WriteAheadLog> wal;         // the log of that directory, attached once it has been replayed
+    SnapshotTables snapshotTables;         // tables unchanged since the snapshot file holding them was written
+    shared_ptr<CheckpointJob> checkpoint;  // the checkpoint running in the background, if any
+
+    // Called by every statement that modified `tableName`, whose rows or schema have to be written again
+    void markChanged(const string &tableName) {
+        ++changes;
+        snapshotTables.erase(tableName);
+    }
+
+    OutputMode outputMode = OutputMode::Pretty;
+    fmt::memory_buffer outputBuffer;  // reused by every query result
+};
+
+
+class WhereCondition {
+public:
+    string column;
+    string operation;
+    string value;
+
+    WhereCondition(string col, string op, string val)
+            : column(col), operation(op), value(val) {}
+};
+
+enum class WhereNodeKind : uint8_t {
+    Condition,
+    And,
+    Or
+};
+
+// Node of a WHERE expression tree; a `Condition` leaf refers to WherePattern::conditions by index
+class WhereNode {
+public:
+    WhereNodeKind kind = WhereNodeKind::Condition;
+    size_t condition = 0;
+    vector<WhereNode> children;
+};
+
+class WherePattern {
+public:
+    vector<WhereCondition> conditions;  // Stores all conditions
+    WhereNode root;                     // AND binds tighter than OR, parentheses group
+};
+
+
+void deleteTable(string &tableName, Tables<int> &tables) {
+    tables.tables.erase(tableName);
+    tables.primaryKeyIndexes.erase(tableName);
+}
+
+// Resolves the primary key columns of a table once per statement, in `primaryKeys` order
+KeyColumns primaryKeyColumns(const string &tableName, Tables<int> &tables) {
+    KeyColumns result;
+    const auto &table = tables.tables[tableName];
+    for (size_t ordinal: table.schema.primaryKeyOrdinals) {
+        result.push_back(&table.columns[ordinal]);
+    }
+    return result;
+}
+
+bool rebuildPrimaryKeyIndex(const string &tableName, Tables<int> &tables) {
+    auto keyColumns = primaryKeyColumns(tableName, tables);
+    auto &index = tables.primaryKeyIndexes[tableName];
+    if (keyColumns.empty()) {
+        index = PrimaryKeyIndex();
+        return true;
+    }
+    return index.rebuild(keyColumns, 0, tables.tables[tableName].numRows);
+}
+
+namespace DBCommands {
+    constexpr string_view create = "create";
+    constexpr string_view insert = "insert";
+    constexpr string_view select = "select";
+    constexpr string_view where = "where";
+    constexpr string_view alter = "alter";
+    constexpr string_view foreign = "foreign";
+    constexpr string_view add = "add";
+    constexpr string_view drop = "drop";
+    constexpr string_view load = "load";
+    constexpr string_view save = "save";
+    constexpr string_view update = "update";
+    constexpr string_view bench = "bench";
+    constexpr string_view set = "set";
+    constexpr string_view copy = "copy";
+    constexpr string_view open = "open";
+    constexpr string_view checkpoint = "checkpoint";
+}
+
+
+/* -- Tokenizer:
+ *
+ *     A statement is split into `string_view` tokens pointing into the statement text; nothing is copied.
+ *     Words are separated by whitespace, `,` or `;`. `(`, `)`, `*`, `=`, `<`, `>`, `<=` and `>=` are tokens of
+ *     their own even without surrounding spaces. Text in single quotes is one token, so values may contain spaces and
+ *     commas. The token keeps its quotes, so a quoted `'('` or `'where'` never reads as syntax; `tokenText` strips
+ *     them where the token is used as a value or path. Keywords are recognised case-insensitively and lowercased in
+ *     place in the source text; identifiers, values and quoted text keep their case.
+ */
+using Tokens = span<const string_view>;
+
+enum class Keyword : uint8_t {
+    None,
+    Add, Alter, And, Bench, Checkpoint, Copy, Create, Drop, Exit, Float, Foreign, From, Insert, Int, Into, Key, Load, Open,
+    Or, Primary, References, Save, Select, Set, String, Table, To, Update, Values, Where
+};
+
+enum CharClass : uint8_t {
+    WordChar,
+    SpaceChar,       // whitespace, `,` and `;`
+    PunctuationChar, // ( ) * =
+    CompareChar,     // < >, optionally followed by =
+    QuoteChar
+};
+
+constexpr array<CharClass, 256> charClasses = [] {
+    array<CharClass, 256> classes{};
+    for (char c: {' ', '\t', '\n', '\v', '\f', '\r', ',', ';'}) classes[static_cast<unsigned char>(c)] = SpaceChar;
+    for (char c: {'(', ')', '*', '='}) classes[static_cast<unsigned char>(c)] = PunctuationChar;
+    classes['<'] = CompareChar;
+    classes['>'] = CompareChar;
+    classes['\''] = QuoteChar;
+    return classes;
+}();
+
+constexpr char asciiLower(char c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c + ('a' - 'A')) : c;
+}
+
+// Case-insensitive keyword lookup: a switch on the length, then at most a handful of comparisons
+Keyword classifyKeyword(string_view word) {
+    char buffer[10];
+    if (word.size() < 2 || word.size() > sizeof(buffer)) return Keyword::None;
+    for (size_t i = 0; i < word.size(); ++i) buffer[i] = asciiLower(word[i]);
+    string_view lower(buffer, word.size());
+
+    switch (lower.size()) {
+        case 2:
+            if (lower == "or") return Keyword::Or;
+            if (lower == "to") return Keyword::To;
+            break;
+        case 3:
+            if (lower == "add") return Keyword::Add;
+            if (lower == "and") return Keyword::And;
+            if (lower == "int") return Keyword::Int;
+            if (lower == "key") return Keyword::Key;
+            if (lower == "set") return Keyword::Set;
+            break;
+        case 4:
+            if (lower == "copy") return Keyword::Copy;
+            if (lower == "drop") return Keyword::Drop;
+            if (lower == "exit") return Keyword::Exit;
+            if (lower == "from") return Keyword::From;
+            if (lower == "into") return Keyword::Into;
+            if (lower == "load") return Keyword::Load;
+            if (lower == "open") return Keyword::Open;
+            if (lower == "save") return Keyword::Save;
+            break;
+        case 5:
+            if (lower == "alter") return Keyword::Alter;
+            if (lower == "bench") return Keyword::Bench;
+            if (lower == "float") return Keyword::Float;
+            if (lower == "table") return Keyword::Table;
+            if (lower == "where") return Keyword::Where;
+            break;
+        case 6:
+            if (lower == "create") return Keyword::Create;
+            if (lower == "insert") return Keyword::Insert;
+            if (lower == "select") return Keyword::Select;
+            if (lower == "string") return Keyword::String;
+            if (lower == "update") return Keyword::Update;
+            if (lower == "values") return Keyword::Values;
+            break;
+        case 7:
+            if (lower == "foreign") return Keyword::Foreign;
+            if (lower == "primary") return Keyword::Primary;
+            break;
+        case 10:
+            if (lower == "checkpoint") return Keyword::Checkpoint;
+            if (lower == "references") return Keyword::References;
+            break;
+        default:
+            break;
+    }
+    return Keyword::None;
+}
+
+// Appends the tokens of `data[0, size)` to `tokens`; the tokens stay valid as long as the text is not modified
+void tokenize(char *data, size_t size, vector<string_view> &tokens) {
+    size_t i = 0;
+
+    while (i < size) {
+        switch (charClasses[static_cast<unsigned char>(data[i])]) {
+            case SpaceChar:
+                ++i;
+                break;
+            case PunctuationChar:
+                tokens.emplace_back(data + i, 1);
+                ++i;
+                break;
+            case CompareChar: {
+                size_t length = (i + 1 < size && data[i + 1] == '=') ? 2 : 1;
+                tokens.emplace_back(data + i, length);
+                i += length;
+                break;
+            }
+            case QuoteChar: {
+                size_t start = i++;
+                while (i < size && data[i] != '\'') ++i;
+                if (i < size) ++i;  // closing quote
+                tokens.emplace_back(data + start, i - start);
+                break;
+            }
+            case WordChar: {
+                size_t start = i;
+                while (i < size) {
+                    CharClass charClass = charClasses[static_cast<unsigned char>(data[i])];
+                    if (charClass != WordChar && charClass != QuoteChar) break;
+                    ++i;
+                }
+                if (classifyKeyword(string_view(data + start, i - start)) != Keyword::None) {
+                    for (size_t j = start; j < i; ++j) data[j] = asciiLower(data[j]);
+                }
+                tokens.emplace_back(data + start, i - start);
+                break;
+            }
+        }
+    }
+}
+
+// The text of a token used as a value: a quoted literal without its quotes, any other token as it is
+string_view tokenText(string_view token) {
+    if (token.empty() || token.front() != '\'') return token;
+    token.remove_prefix(1);
+    if (!token.empty() && token.back() == '\'') token.remove_suffix(1);
+    return token;
+}
+
+/* -- Statement splitting:
+ *
+ *     A query or a loaded file may hold any number of statements. `splitStatements` walks the tokens once and hands
+ *     every statement to the callback as a span over the token buffer, in the order they are written, so an `insert`
+ *     that follows an `alter` sees the altered table.
+ *
+ *     A statement starts at a leading keyword outside parentheses that is not the right-hand side of a comparison
+ *     (`where name = 'select'` stays one statement). `alter` and `drop` start a statement only when followed by
+ *     `table`, and the first `set` after an `update` belongs to that update.
+ *
+ *     A file read in chunks is split as its tokens arrive: a `StatementSplit` keeps where the scan stopped, so each
+ *     token is looked at once however long the statement that is still being read.
+ */
+bool isStatementStart(Tokens tokens, size_t i) {
+    string_view word = tokens[i];
+    if (word == DBCommands::alter || word == DBCommands::drop) {
+        return i + 1 < tokens.size() && tokens[i + 1] == "table";
+    }
+    return word == DBCommands::create || word == DBCommands::insert || word == DBCommands::select ||
+           word == DBCommands::update || word == DBCommands::set || word == DBCommands::load ||
+           word == DBCommands::save || word == DBCommands::bench || word == DBCommands::copy ||
+           word == DBCommands::open || word == DBCommands::checkpoint || word == "exit";
+}
+
+bool isCompareToken(string_view token) {
+    return token == "=" || token == "<" || token == ">" || token == "<=" || token == ">=";
+}
+
+struct StatementSplit {
+    size_t begin = 0;  // first token of the statement that has not ended yet
+    size_t next = 0;   // first token not scanned yet
+    int depth = 0;
+    bool updateAwaitingSet = false;
+};
+
+// Scans `tokens[split.next, end)` and hands over every statement that ends there; the last one stays open in `split`
+template<typename OnStatement>
+void splitStatements(Tokens tokens, size_t end, StatementSplit &split, OnStatement &&onStatement) {
+    for (size_t i = split.next; i < end; ++i) {
+        if (tokens[i] == "(") {
+            ++split.depth;
+            continue;
+        }
+        if (tokens[i] == ")") {
+            split.depth = max(split.depth - 1, 0);
+            continue;
+        }
+        if (split.depth > 0 || !isStatementStart(tokens, i) || (i > 0 && isCompareToken(tokens[i - 1]))) {
+            continue;
+        }
+        if (tokens[i] == DBCommands::set && split.updateAwaitingSet) {
+            split.updateAwaitingSet = false;
+            continue;
+        }
+
+        if (i > split.begin) {
+            onStatement(tokens.subspan(split.begin, i - split.begin));
+        }
+        split.begin = i;
+        split.updateAwaitingSet = tokens[i] == DBCommands::update;
+    }
+    split.next = max(split.next, end);
+}
+
+template<typename OnStatement>
+void splitStatements(Tokens tokens, OnStatement &&onStatement) {
+    StatementSplit split;
+    splitStatements(tokens, tokens.size(), split, onStatement);
+    if (split.begin < tokens.size()) {
+        onStatement(tokens.subspan(split.begin));
+    }
+}
+
+void tokenize(string &source, vector<string_view> &tokens) {
+    tokenize(source.data(), source.size(), tokens);
+}
+
+// Length of the prefix of `text` that ends on a separator outside quotes; no token crosses its end
+size_t completeTokensEnd(string_view text) {
+    size_t end = 0;
+    size_t i = 0;
+    while (i < text.size()) {
+        CharClass charClass = charClasses[static_cast<unsigned char>(text[i])];
+        if (charClass == SpaceChar) {
+            end = ++i;
+        } else if (charClass == QuoteChar) {
+            ++i;
+            while (i < text.size() && text[i] != '\'') ++i;
+            if (i < text.size()) ++i;
+        } else if (charClass == WordChar) {
+            while (i < text.size()) {
+                charClass = charClasses[static_cast<unsigned char>(text[i])];
+                if (charClass != WordChar && charClass != QuoteChar) break;
+                ++i;
+            }
+        } else {
+            ++i;
+        }
+    }
+    return end;
+}
+
+bool processPrimaryKeysWithCreate(Tokens query, Tables<int> &tables) {
+    vector<Tokens::iterator> primaryLocationVector;
+    for (auto i = query.begin(); i != query.end(); i++) {
+        if (*i == "primary") {
+            primaryLocationVector.push_back(i);
+        }
+    }
+
+    if (primaryLocationVector.empty()) {
+        fmt::println("{}", "no primary key in table !");
+        return false;
+    }
+    for (auto primaryLocation: primaryLocationVector) {
+        auto keyLocation = primaryLocation + 1;
+
+        if (*(keyLocation + 1) == "(") {
+            string tableName(query[1]);
+            string nameOfPrimaryKeyColumn(*(keyLocation + 2));
+
+            if (!(tables.tables[tableName].schema.contains(nameOfPrimaryKeyColumn))) {
+                fmt::println("no such column exist {}", nameOfPrimaryKeyColumn);
+                tables.primaryKeys.erase(tableName);
+                return false;
+            }
+
+            tables.primaryKeys[tableName].push_back(nameOfPrimaryKeyColumn);
+            continue;
+        } else {
+            string tableName(query[1]);
+            string nameOfPrimaryKeyColumn(*(primaryLocation - 2));
+            if (!(tables.tables[tableName].schema.contains(nameOfPrimaryKeyColumn))) {
+                fmt::println("no such column exist {}", nameOfPrimaryKeyColumn);
+                tables.primaryKeys.clear();
+                return false;
+            }
+            tables.primaryKeys[tableName].push_back(nameOfPrimaryKeyColumn);
+        }
+
+    }
+    return true;
+
+}
+
+
+void processCreate(Tokens query, Tables<int> &tables) {
+
+    string tableName(query[1]);
+
+    // Initialize the RowColumn for this table
+    RowColumn<int> data;
+
+    // Process the column definitions inside parentheses
+    bool insideParentheses = false;
+    string currentColumnName;
+    string currentColumnType;
+
+    for (int i = 2; i < query.size(); ++i) {
+        string_view word = query[i];
+        if (word == "primary") {
+            if (query[i + 1] == "key") {
+                if (query[i + 2] == "(") {
+                    i = i + 4;
+                    continue;
+                }
+                i = i + 1;
+                continue;
+            }
+        }
+        if (word == "(") {
+            insideParentheses = true;
+            continue;
+        }
+        if (word == ")") {
+            insideParentheses = false;
+            continue;
+        }
+
+        if (insideParentheses) {
+            if (currentColumnName.empty()) {
+                // It's the column name
+                currentColumnName = word;
+            } else {
+                // It's the column type
+                currentColumnType = word;
+
+                // The type is recorded in the schema, the column itself starts empty
+                ColumnType type;
+                if (parseColumnType(currentColumnType, type) && !data.schema.contains(currentColumnName)) {
+                    data.addColumn(currentColumnName, type, defaultColumnValue(type));
+                }
+
+                // Reset for next column definition
+                currentColumnName.clear();
+                currentColumnType.clear();
+            }
+        }
+    }
+
+    // Add this table to the tables map
+    tables.tables[tableName] = data;
+    tables.markChanged(tableName);
+
+    if (!processPrimaryKeysWithCreate(query, tables)) {
+        deleteTable(tableName, tables);
+        return;
+    }
+
+    tables.tables[tableName].schema.setPrimaryKey(tables.primaryKeys[tableName]);
+    rebuildPrimaryKeyIndex(tableName, tables);
+}
+
+/* Recursive descent parser for the tokens after `where`:
+ *
+ *     expression := term { or term }
+ *     term       := factor { and factor }
+ *     factor     := ( expression ) | column operator value
+ */
+class WhereParser {
+public:
+    WhereParser(Tokens::iterator begin, Tokens::iterator end, WherePattern &pattern)
+            : current(begin), end(end), pattern(pattern) {}
+
+    bool parse() {
+        if (current == end) {
+            fmt::println("WHERE clause is empty");
+            return false;
+        }
+        if (!parseExpression(pattern.root)) return false;
+        if (current != end) {
+            fmt::println("Unexpected '{}' in WHERE clause", *current);
+            return false;
+        }
+        return true;
+    }
+
+private:
+    Tokens::iterator current;
+    Tokens::iterator end;
+    WherePattern &pattern;
+
+    bool parseExpression(WhereNode &node) {
+        return parseChain(node, WhereNodeKind::Or, "or", &WhereParser::parseTerm);
+    }
+
+    bool parseTerm(WhereNode &node) {
+        return parseChain(node, WhereNodeKind::And, "and", &WhereParser::parseFactor);
+    }
+
+    // Parses `operand { keyword operand }`, flattening the operands into one node of `kind`
+    bool parseChain(WhereNode &node, WhereNodeKind kind, const char *keyword, bool (WhereParser::*parseOperand)(WhereNode &)) {
+        WhereNode operand;
+        if (!(this->*parseOperand)(operand)) return false;
+        if (current == end || *current != keyword) {
+            node = std::move(operand);
+            return true;
+        }
+
+        node = WhereNode();
+        node.kind = kind;
+        node.children.push_back(std::move(operand));
+        while (current != end && *current == keyword) {
+            ++current;
+            WhereNode next;
+            if (!(this->*parseOperand)(next)) return false;
+            if (next.kind == kind) {
+                for (auto &child: next.children) node.children.push_back(std::move(child));
+            } else {
+                node.children.push_back(std::move(next));
+            }
+        }
+        return true;
+    }
+
+    bool parseFactor(WhereNode &node) {
+        if (current == end) {
+            fmt::println("WHERE clause ends unexpectedly");
+            return false;
+        }
+
+        if (*current == "(") {
+            ++current;
+            if (!parseExpression(node)) return false;
+            if (current == end || *current != ")") {
+                fmt::println("Missing ')' in WHERE clause");
+                return false;
+            }
+            ++current;
+            return true;
+        }
+
+        if (end - current < 3) {
+            fmt::println("Incomplete condition in WHERE clause");
+            return false;
+        }
+        string column(*current++);
+        string operation(*current++);
+        string value(tokenText(*current++));
+
+        node = WhereNode();
+        node.condition = pattern.conditions.size();
+        pattern.conditions.push_back(WhereCondition(column, operation, value));
+        return true;
+    }
+};
+
+// Parses everything after the `where` keyword; reports the problem and returns false on a malformed clause
+bool processWhereStatement(Tokens query, WherePattern &wherePattern) {
+    auto whereLoc = find(query.begin(), query.end(), DBCommands::where);
+
+    // Start reading from after the 'WHERE' keyword
+    return WhereParser(whereLoc + 1, query.end(), wherePattern).parse();
+}
+
+enum class CompareOp : uint8_t {
+    Equal,
+    Less,
+    Greater,
+    LessEqual,
+    GreaterEqual
+};
+
+bool parseCompareOp(const string &text, CompareOp &op) {
+    if (text == "=") {
+        op = CompareOp::Equal;
+    } else if (text == "<") {
+        op = CompareOp::Less;
+    } else if (text == ">") {
+        op = CompareOp::Greater;
+    } else if (text == "<=") {
+        op = CompareOp::LessEqual;
+    } else if (text == ">=") {
+        op = CompareOp::GreaterEqual;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+template<typename V>
+bool compareValues(const V &lhs, CompareOp op, const V &rhs) {
+    switch (op) {
+        case CompareOp::Equal:
+            return lhs == rhs;
+        case CompareOp::Less:
+            return lhs < rhs;
+        case CompareOp::Greater:
+            return lhs > rhs;
+        case CompareOp::LessEqual:
+            return lhs <= rhs;
+        case CompareOp::GreaterEqual:
+            return lhs >= rhs;
+    }
+    return false;
+}
+
+
+/* -- Batch filtering:
+ *
+ *     WHERE clauses are evaluated over batches of `filterBatchSize` rows. Every condition turns a batch of its
+ *     column into a bitmask (bit i set = row begin + i passes), masks of several conditions are combined word by
+ *     word and the final mask is expanded into a selection vector of row numbers. The inner loops only read one
+ *     contiguous buffer and have no data-dependent branches, which lets the compiler vectorize them.
+ */
+constexpr size_t filterBatchSize = 1024;
+constexpr size_t batchMaskWords = filterBatchSize / 64;
+
+using BatchMask = array<uint64_t, batchMaskWords>;
+
+// Sets the bits of the first `count` rows and clears the rest
+void setBatchMask(size_t count, BatchMask &mask) {
+    for (size_t word = 0; word < batchMaskWords; ++word) {
+        size_t base = word * 64;
+        if (base + 64 <= count) {
+            mask[word] = ~uint64_t(0);
+        } else {
+            mask[word] = base < count ? (~uint64_t(0) >> (64 - (count - base))) : 0;
+        }
+    }
+}
+
+// Sets the bits of rows [first, first + rows), leaving the others as they are
+void setBatchMaskRange(size_t first, size_t rows, BatchMask &mask) {
+    for (size_t end = first + rows; first < end;) {
+        size_t bits = min<size_t>(64 - first % 64, end - first);
+        mask[first / 64] |= (~uint64_t(0) >> (64 - bits)) << (first % 64);
+        first += bits;
+    }
+}
+
+template<typename Load, typename Predicate>
+void fillBatchMask(size_t count, Load load, Predicate predicate, BatchMask &mask) {
+    for (size_t word = 0; word < batchMaskWords; ++word) {
+        size_t base = word * 64;
+        size_t rows = base < count ? min<size_t>(64, count - base) : 0;
+        uint64_t bits = 0;
+        for (size_t i = 0; i < rows; ++i) {
+            bits |= uint64_t(predicate(load(base + i))) << i;
+        }
+        mask[word] = bits;
+    }
+}
+
+template<typename Load, typename V>
+void compareBatch(size_t count, Load load, CompareOp op, const V &constant, BatchMask &mask) {
+    switch (op) {
+        case CompareOp::Equal:
+            fillBatchMask(count, load, [&](const V &value) { return value == constant; }, mask);
+            break;
+        case CompareOp::Less:
+            fillBatchMask(count, load, [&](const V &value) { return value < constant; }, mask);
+            break;
+        case CompareOp::Greater:
+            fillBatchMask(count, load, [&](const V &value) { return value > constant; }, mask);
+            break;
+        case CompareOp::LessEqual:
+            fillBatchMask(count, load, [&](const V &value) { return value <= constant; }, mask);
+            break;
+        case CompareOp::GreaterEqual:
+            fillBatchMask(count, load, [&](const V &value) { return value >= constant; }, mask);
+            break;
+    }
+}
+
+/* -- Comparison kernels:
+ *
+ *     Int and float conditions run through explicit SIMD kernels that compare a run of values against a constant
+ *     and write one mask bit per value (64 values per mask word, the last word may be partial). The widest
+ *     instruction set supported by the CPU is picked once at runtime: AVX2 (8 lanes), SSE4.2 (4 lanes) or the
+ *     portable scalar loop, which also handles every tail that does not fill a whole word.
+ */
+enum class KernelLevel : uint8_t {
+    Scalar,
+    Sse42,
+    Avx2
+};
+
+constexpr size_t compareOpCount = 5;
+
+using Int32Kernel = void (*)(const int32_t *values, size_t count, int32_t constant, uint64_t *mask);
+using FloatKernel = void (*)(const float *values, size_t count, float constant, uint64_t *mask);
+
+struct FilterKernels {
+    KernelLevel level;
+    const char *name;
+    array<Int32Kernel, compareOpCount> ints;    // indexed by CompareOp
+    array<FloatKernel, compareOpCount> floats;
+};
+
+// Scalar kernel; `firstRow` lets the vector kernels hand over their tail, it must be a multiple of 64
+template<CompareOp op, typename V>
+void compareScalar(const V *values, size_t count, V constant, uint64_t *mask, size_t firstRow = 0) {
+    for (size_t base = firstRow; base < count; base += 64) {
+        size_t rows = min<size_t>(64, count - base);
+        uint64_t bits = 0;
+        for (size_t i = 0; i < rows; ++i) {
+            bits |= uint64_t(compareValues(values[base + i], op, constant)) << i;
+        }
+        mask[base / 64] = bits;
+    }
+}
+
+#ifdef SQL_X86_KERNELS
+
+template<CompareOp op>
+__attribute__((target("avx2"))) inline uint32_t avx2Int32Mask(__m256i values, __m256i constant) {
+    if constexpr (op == CompareOp::Equal) {
+        return _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(values, constant)));
+    } else if constexpr (op == CompareOp::Greater) {
+        return _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(values, constant)));
+    } else if constexpr (op == CompareOp::Less) {
+        return _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(constant, values)));
+    } else if constexpr (op == CompareOp::LessEqual) {
+        return ~_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(values, constant))) & 0xFFu;
+    } else {
+        return ~_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(constant, values))) & 0xFFu;
+    }
+}
+
+template<CompareOp op>
+__attribute__((target("avx2"))) inline uint32_t avx2FloatMask(__m256 values, __m256 constant) {
+    if constexpr (op == CompareOp::Equal) {
+        return _mm256_movemask_ps(_mm256_cmp_ps(values, constant, _CMP_EQ_OQ));
+    } else if constexpr (op == CompareOp::Greater) {
+        return _mm256_movemask_ps(_mm256_cmp_ps(values, constant, _CMP_GT_OQ));
+    } else if constexpr (op == CompareOp::Less) {
+        return _mm256_movemask_ps(_mm256_cmp_ps(values, constant, _CMP_LT_OQ));
+    } else if constexpr (op == CompareOp::LessEqual) {
+        return _mm256_movemask_ps(_mm256_cmp_ps(values, constant, _CMP_LE_OQ));
+    } else {
+        return _mm256_movemask_ps(_mm256_cmp_ps(values, constant, _CMP_GE_OQ));
+    }
+}
+
+template<CompareOp op>
+__attribute__((target("avx2"))) void compareInt32Avx2(const int32_t *values, size_t count, int32_t constant,
+                                                      uint64_t *mask) {
+    __m256i broadcast = _mm256_set1_epi32(constant);
+    size_t fullWords = count / 64;
+    for (size_t word = 0; word < fullWords; ++word) {
+        const int32_t *block = values + word * 64;
+        uint64_t bits = 0;
+        for (size_t lane = 0; lane < 8; ++lane) {
+            __m256i loaded = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(block + lane * 8));
+            bits |= uint64_t(avx2Int32Mask<op>(loaded, broadcast)) << (lane * 8);
+        }
+        mask[word] = bits;
+    }
+    compareScalar<op>(values, count, constant, mask, fullWords * 64);
+}
+
+template<CompareOp op>
+__attribute__((target("avx2"))) void compareFloatAvx2(const float *values, size_t count, float constant,
+                                                      uint64_t *mask) {
+    __m256 broadcast = _mm256_set1_ps(constant);
+    size_t fullWords = count / 64;
+    for (size_t word = 0; word < fullWords; ++word) {
+        const float *block = values + word * 64;
+        uint64_t bits = 0;
+        for (size_t lane = 0; lane < 8; ++lane) {
+            bits |= uint64_t(avx2FloatMask<op>(_mm256_loadu_ps(block + lane * 8), broadcast)) << (lane * 8);
+        }
+        mask[word] = bits;
+    }
+    compareScalar<op>(values, count, constant, mask, fullWords * 64);
+}
+
+template<CompareOp op>
+__attribute__((target("sse4.2"))) inline uint32_t sseInt32Mask(__m128i values, __m128i constant) {
+    if constexpr (op == CompareOp::Equal) {
+        return _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(values, constant)));
+    } else if constexpr (op == CompareOp::Greater) {
+        return _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(values, constant)));
+    } else if constexpr (op == CompareOp::Less) {
+        return _mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(values, constant)));
+    } else if constexpr (op == CompareOp::LessEqual) {
+        return ~_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(values, constant))) & 0xFu;
+    } else {
+        return ~_mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(values, constant))) & 0xFu;
+    }
+}
+
+template<CompareOp op>
+__attribute__((target("sse4.2"))) inline uint32_t sseFloatMask(__m128 values, __m128 constant) {
+    if constexpr (op == CompareOp::Equal) {
+        return _mm_movemask_ps(_mm_cmpeq_ps(values, constant));
+    } else if constexpr (op == CompareOp::Greater) {
+        return _mm_movemask_ps(_mm_cmpgt_ps(values, constant));
+    } else if constexpr (op == CompareOp::Less) {
+        return _mm_movemask_ps(_mm_cmplt_ps(values, constant));
+    } else if constexpr (op == CompareOp::LessEqual) {
+        return _mm_movemask_ps(_mm_cmple_ps(values, constant));
+    } else {
+        return _mm_movemask_ps(_mm_cmpge_ps(values, constant));
+    }
+}
+
+template<CompareOp op>
+__attribute__((target("sse4.2"))) void compareInt32Sse42(const int32_t *values, size_t count, int32_t constant,
+                                                         uint64_t *mask) {
+    __m128i broadcast = _mm_set1_epi32(constant);
+    size_t fullWords = count / 64;
+    for (size_t word = 0; word < fullWords; ++word) {
+        const int32_t *block = values + word * 64;
+        uint64_t bits = 0;
+        for (size_t lane = 0; lane < 16; ++lane) {
+            __m128i loaded = _mm_loadu_si128(reinterpret_cast<const __m128i *>(block + lane * 4));
+            bits |= uint64_t(sseInt32Mask<op>(loaded, broadcast)) << (lane * 4);
+        }
+        mask[word] = bits;
+    }
+    compareScalar<op>(values, count, constant, mask, fullWords * 64);
+}
+
+template<CompareOp op>
+__attribute__((target("sse4.2"))) void compareFloatSse42(const float *values, size_t count, float constant,
+                                                         uint64_t *mask) {
+    __m128 broadcast = _mm_set1_ps(constant);
+    size_t fullWords = count / 64;
+    for (size_t word = 0; word < fullWords; ++word) {
+        const float *block = values + word * 64;
+        uint64_t bits = 0;
+        for (size_t lane = 0; lane < 16; ++lane) {
+            bits |= uint64_t(sseFloatMask<op>(_mm_loadu_ps(block + lane * 4), broadcast)) << (lane * 4);
+        }
+        mask[word] = bits;
+    }
+    compareScalar<op>(values, count, constant, mask, fullWords * 64);
+}
+
+#endif
+
+// Kernel table entries follow the declaration order of CompareOp
+#define SQL_KERNEL_TABLE(kernel) \
+    {kernel<CompareOp::Equal>, kernel<CompareOp::Less>, kernel<CompareOp::Greater>, \
+     kernel<CompareOp::LessEqual>, kernel<CompareOp::GreaterEqual>}
+
+template<CompareOp op>
+void compareInt32Scalar(const int32_t *values, size_t count, int32_t constant, uint64_t *mask) {
+    compareScalar<op>(values, count, constant, mask);
+}
+
+template<CompareOp op>
+void compareFloatScalar(const float *values, size_t count, float constant, uint64_t *mask) {
+    compareScalar<op>(values, count, constant, mask);
+}
+
+bool isKernelLevelSupported(KernelLevel level) {
+    switch (level) {
+        case KernelLevel::Scalar:
+            return true;
+#ifdef SQL_X86_KERNELS
+        case KernelLevel::Sse42:
+            return __builtin_cpu_supports("sse4.2");
+        case KernelLevel::Avx2:
+            return __builtin_cpu_supports("avx2");
+#endif
+        default:
+            return false;
+    }
+}
+
+// Kernels of one instruction set; only call with a level that isKernelLevelSupported
+const FilterKernels &filterKernels(KernelLevel level) {
+    static const FilterKernels scalar{KernelLevel::Scalar, "scalar",
+                                      SQL_KERNEL_TABLE(compareInt32Scalar), SQL_KERNEL_TABLE(compareFloatScalar)};
+#ifdef SQL_X86_KERNELS
+    static const FilterKernels sse42{KernelLevel::Sse42, "sse4.2",
+                                     SQL_KERNEL_TABLE(compareInt32Sse42), SQL_KERNEL_TABLE(compareFloatSse42)};
+    static const FilterKernels avx2{KernelLevel::Avx2, "avx2",
+                                    SQL_KERNEL_TABLE(compareInt32Avx2), SQL_KERNEL_TABLE(compareFloatAvx2)};
+    if (level == KernelLevel::Avx2) return avx2;
+    if (level == KernelLevel::Sse42) return sse42;
+#endif
+    return scalar;
+}
+
+// The best kernels for this CPU, detected on first use
+const FilterKernels &activeFilterKernels() {
+    static const FilterKernels &active = filterKernels(
+            isKernelLevelSupported(KernelLevel::Avx2) ? KernelLevel::Avx2 :
+            isKernelLevelSupported(KernelLevel::Sse42) ? KernelLevel::Sse42 : KernelLevel::Scalar);
+    return active;
+}
+
+#undef SQL_KERNEL_TABLE
+
+
+// Expands the mask of the batch starting at `begin` into row numbers; returns how many rows were selected
+size_t toSelectionVector(const BatchMask &mask, size_t begin, uint32_t *selection) {
+    size_t selected = 0;
+    for (size_t word = 0; word < batchMaskWords; ++word) {
+        uint64_t bits = mask[word];
+        while (bits) {
+            selection[selected++] = static_cast<uint32_t>(begin + word * 64 + countr_zero(bits));
+            bits &= bits - 1;
+        }
+    }
+    return selected;
+}
+
+
+/* A WhereCondition bound to one table: the column is resolved, the operator is an enum and the constant is
+ * already converted to the column type, so evaluating a batch is a single typed comparison kernel.
+ */
+class CompiledCondition {
+public:
+    const Column *column = nullptr;
+    CompareOp op = CompareOp::Equal;
+    int32_t intValue = 0;
+    float floatValue = 0.0f;
+    string stringValue;
+    uint32_t stringPrefix = 0;  // stringPrefixKey of stringValue
+
+    // False if no cell within `zone` can pass. String zones bound prefix keys only, so a string whose key equals
+    // the constant's may order either way.
+    bool mayMatch(const Zone &zone) const {
+        double value = 0.0;
+        bool exact = true;
+        switch (column->type) {
+            case ColumnType::Int:
+                value = intValue;
+                break;
+            case ColumnType::Float:
+                value = floatValue;
+                break;
+            case ColumnType::String:
+                value = stringPrefix;
+                exact = false;
+                break;
+        }
+        switch (op) {
+            case CompareOp::Equal:
+                return zone.min <= value && value <= zone.max;
+            case CompareOp::Less:
+                return exact ? zone.min < value : zone.min <= value;
+            case CompareOp::LessEqual:
+                return zone.min <= value;
+            case CompareOp::Greater:
+                return exact ? zone.max > value : zone.max >= value;
+            case CompareOp::GreaterEqual:
+                return zone.max >= value;
+        }
+        return true;
+    }
+
+    void evaluateBatch(size_t begin, size_t count, BatchMask &mask) const {
+        switch (column->type) {
+            case ColumnType::Int: {
+                mask.fill(0);
+                const IntChunk *chunk = column->ints.chunkOf(begin);
+                if (chunk && chunk->encoding == IntEncoding::RunLength) {
+                    // One comparison decides a whole run
+                    size_t offset = begin % zoneRows;
+                    chunk->forEachRun(offset, count, [&](size_t first, size_t rows, int32_t value) {
+                        if (compareValues(value, op, intValue)) setBatchMaskRange(first - offset, rows, mask);
+                    });
+                    break;
+                }
+                array<int32_t, filterBatchSize> scratch;
+                activeFilterKernels().ints[static_cast<size_t>(op)](column->ints.cells(begin, count, scratch.data()),
+                                                                    count, intValue, mask.data());
+                break;
+            }
+            case ColumnType::Float:
+                mask.fill(0);
+                activeFilterKernels().floats[static_cast<size_t>(op)](column->floats.cells(begin), count,
+                                                                      floatValue, mask.data());
+                break;
+            case ColumnType::String: {
+                const StringColumn &values = column->strings;
+                if (op == CompareOp::Equal && values.isDictionaryEncoded()) {
+                    // Codes are below 2^31, so the int kernel compares them
+                    mask.fill(0);
+                    int64_t code = values.findCode(stringValue);
+                    if (code < 0) break;
+                    activeFilterKernels().ints[static_cast<size_t>(op)](
+                            reinterpret_cast<const int32_t *>(values.codeData(begin)), count,
+                            static_cast<int32_t>(code), mask.data());
+                    break;
+                }
+                if (op == CompareOp::Equal) {
+                    fillBatchMask(count, [begin](size_t i) { return begin + i; },
+                                  [&values, this](size_t row) { return values.equals(row, stringValue, stringPrefix); },
+                                  mask);
+                    break;
+                }
+                // Comparing the order of each cell against 0 applies `op`
+                compareBatch(count, [&values, this, begin](size_t i) {
+                    return values.compare(begin + i, stringValue, stringPrefix);
+                }, op, 0, mask);
+                break;
+            }
+        }
+    }
+};
+
+/* WHERE expression tree bound to one table. Before evaluation the children of every AND / OR node are reordered
+ * so that cheap and decisive predicates run first: a batch whose AND mask is already empty, or whose OR mask is
+ * already full, skips the remaining children.
+ *
+ * Without statistics the planner uses the classic estimates: `=` keeps 1/10 of the rows, a range comparison 1/3,
+ * and a string comparison costs four times a numeric one, unless it is `=` on dictionary codes.
+ */
+class CompiledWhere {
+public:
+    WhereNodeKind kind = WhereNodeKind::Condition;
+    CompiledCondition condition;
+    vector<CompiledWhere> children;
+
+    double cost = 0.0;         // estimated work per row
+    double selectivity = 1.0;  // estimated fraction of rows that pass
+
+    // Filters rows [begin, begin + count) of one batch into `mask`
+    void evaluateBatch(size_t begin, size_t count, BatchMask &mask) const {
+        if (kind == WhereNodeKind::Condition) {
+            condition.evaluateBatch(begin, count, mask);
+            return;
+        }
+
+        children.front().evaluateBatch(begin, count, mask);
+
+        BatchMask full;
+        if (kind == WhereNodeKind::Or) setBatchMask(count, full);
+
+        BatchMask current;
+        for (size_t i = 1; i < children.size(); ++i) {
+            if (kind == WhereNodeKind::And ? isBatchMaskEmpty(mask) : mask == full) return;
+
+            children[i].evaluateBatch(begin, count, current);
+            for (size_t word = 0; word < batchMaskWords; ++word) {
+                mask[word] = kind == WhereNodeKind::And ? (mask[word] & current[word]) : (mask[word] | current[word]);
+            }
+        }
+    }
+
+    // False if the zones of row group `group` rule out every row in it
+    bool mayMatch(size_t group) const {
+        switch (kind) {
+            case WhereNodeKind::Condition:
+                return condition.mayMatch(condition.column->zone(group));
+            case WhereNodeKind::And:
+                return all_of(children.begin(), children.end(), [group](const auto &child) {
+                    return child.mayMatch(group);
+                });
+            case WhereNodeKind::Or:
+                return any_of(children.begin(), children.end(), [group](const auto &child) {
+                    return child.mayMatch(group);
+                });
+        }
+        return true;
+    }
+
+    // Computes cost / selectivity estimates bottom-up and orders the children of every node
+    void plan() {
+        if (kind == WhereNodeKind::Condition) {
+            bool comparesCodes = condition.op == CompareOp::Equal && condition.column->strings.isDictionaryEncoded();
+            cost = condition.column->type == ColumnType::String && !comparesCodes ? 4.0 : 1.0;
+            selectivity = condition.op == CompareOp::Equal ? 0.1 : 1.0 / 3.0;
+            return;
+        }
+
+        for (auto &child: children) child.plan();
+
+        // AND: run first what removes most rows per unit of work, OR: what accepts most rows per unit of work
+        auto rank = [this](const CompiledWhere &node) {
+            double decided = kind == WhereNodeKind::And ? 1.0 - node.selectivity : node.selectivity;
+            return node.cost / max(decided, 1e-9);
+        };
+        stable_sort(children.begin(), children.end(), [&rank](const CompiledWhere &lhs, const CompiledWhere &rhs) {
+            return rank(lhs) < rank(rhs);
+        });
+
+        cost = 0.0;
+        double passing = 1.0;
+        for (const auto &child: children) {
+            cost += child.cost;
+            passing *= kind == WhereNodeKind::And ? child.selectivity : 1.0 - child.selectivity;
+        }
+        selectivity = kind == WhereNodeKind::And ? passing : 1.0 - passing;
+    }
+
+private:
+    static bool isBatchMaskEmpty(const BatchMask &mask) {
+        for (uint64_t word: mask) {
+            if (word) return false;
+        }
+        return true;
+    }
+};
+
+
+// Binds one parsed condition to `table`; reports the problem and returns false if a column, operator
+// or constant is invalid
+template<typename T>
+bool compileWhereCondition(const WhereCondition &condition, const RowColumn<T> &table, CompiledCondition &compiled) {
+    const ColumnSchema *columnSchema = table.schema.find(condition.column);
+    if (!columnSchema) {
+        fmt::println("No such column '{}' in WHERE clause", condition.column);
+        return false;
+    }
+    compiled.column = &table.columns[columnSchema->ordinal];
+
+    if (!parseCompareOp(condition.operation, compiled.op)) {
+        fmt::println("Unsupported operator '{}' in WHERE clause", condition.operation);
+        return false;
+    }
+
+    ColumnValue value;
+    if (!parseColumnValue(condition.value, columnSchema->type, value)) {
+        fmt::println("Invalid value '{}' for column '{}' in WHERE clause", condition.value, condition.column);
+        return false;
+    }
+    switch (columnSchema->type) {
+        case ColumnType::Int:
+            compiled.intValue = get<int>(value);
+            break;
+        case ColumnType::Float:
+            compiled.floatValue = get<float>(value);
+            break;
+        case ColumnType::String:
+            compiled.stringValue = std::move(get<string>(value));
+            compiled.stringPrefix = stringPrefixKey(compiled.stringValue);
+            break;
+    }
+    return true;
+}
+
+template<typename T>
+bool compileWhereNode(const WherePattern &pattern, const WhereNode &node, const RowColumn<T> &table,
+                      CompiledWhere &compiled) {
+    compiled.kind = node.kind;
+    if (node.kind == WhereNodeKind::Condition) {
+        return compileWhereCondition(pattern.conditions[node.condition], table, compiled.condition);
+    }
+
+    compiled.children.resize(node.children.size());
+    for (size_t i = 0; i < node.children.size(); ++i) {
+        if (!compileWhereNode(pattern, node.children[i], table, compiled.children[i])) return false;
+    }
+    return true;
+}
+
+// Compiles and plans a parsed WHERE clause against `table` once per statement
+template<typename T>
+bool compileWherePattern(const WherePattern &pattern, const RowColumn<T> &table, CompiledWhere &compiled) {
+    if (!compileWhereNode(pattern, pattern.root, table, compiled)) return false;
+    compiled.plan();
+    return true;
+}
+
+
+/* The one filter path shared by select and update: calls `visit(row)` for every row that passes `where`
+ * (every row if `where` is null), in row order. Row groups whose zone maps rule out `where` are skipped unread.
+ * Each batch is fully filtered before any of its rows is visited, so `visit` may modify the row it is given.
+ */
+template<typename Visit>
+void forEachMatchingRow(const CompiledWhere *where, size_t numRows, Visit &&visit) {
+    BatchMask mask;
+    array<uint32_t, filterBatchSize> selection;
+
+    static_assert(zoneRows % filterBatchSize == 0);
+
+    for (size_t begin = 0; begin < numRows; begin += filterBatchSize) {
+        // Skip complete row groups whose zones rule out the whole clause
+        while (where && begin % zoneRows == 0 && begin + zoneRows <= numRows && !where->mayMatch(begin / zoneRows)) {
+            begin += zoneRows;
+        }
+        if (begin >= numRows) break;
+        size_t count = min(filterBatchSize, numRows - begin);
+
+        if (where) {
+            where->evaluateBatch(begin, count, mask);
+        } else {
+            setBatchMask(count, mask);
+        }
+
+        size_t selected = toSelectionVector(mask, begin, selection.data());
+        for (size_t i = 0; i < selected; ++i) {
+            visit(selection[i]);
+        }
+    }
+}
+
+
+void processSelect(Tokens query, Tables<int> &tables) {
+    if (query.size() < 2) {
+        fmt::println("Invalid SELECT format.");
+        return;
+    }
+
+    if (find(query.begin(), query.end(), DBCommands::insert) != query.end() ||
+        find(query.begin(), query.end(), DBCommands::create) != query.end()) {
+        fmt::println("Select query cannot contain keywords for Insert or Create.");
+        return;
+    }
+
+    bool isSelectingColumns = true;
+    vector<string> targetedColumns;
+    string tableName;
+
+    for (auto it = query.begin() + 1; it != query.end(); ++it) {
+        if (*it == "from") {
+            isSelectingColumns = false;
+            continue;
+        }
+
+        if (isSelectingColumns) {
+            targetedColumns.emplace_back(*it);
+        } else {
+            tableName = *it;
+            break;
+        }
+    }
+
+    if (tables.tables.count(tableName) == 0) {
+        fmt::println("No such table exists: '{}'", tableName);
+        return;
+    }
+
+    auto &table = tables.tables[tableName];
+
+    vector<string> actualColumnsToPrint;
+    vector<const Column *> columnsToPrint;
+    bool isWherePresent = false;
+    CompiledWhere pattern;
+
+    if (std::find(query.begin(), query.end(), DBCommands::where) != query.end()) {
+        WherePattern parsedPattern;
+        if (!processWhereStatement(query, parsedPattern) || !compileWherePattern(parsedPattern, table, pattern)) {
+            return;
+        }
+        isWherePresent = true;
+    }
+
+    // Add targeted columns for SELECT
+    if (targetedColumns.size() == 1 && targetedColumns[0] == "*") {
+        // Select all columns, in the order they were declared
+        for (const auto &columnSchema: table.schema.columns) {
+            actualColumnsToPrint.push_back(columnSchema.name);
+            columnsToPrint.push_back(&table.columns[columnSchema.ordinal]);
+        }
+    } else {
+        for (const auto &target: targetedColumns) {
+            if (!table.schema.contains(target)) {
+                fmt::println("No such column '{}' in table '{}'", target, tableName);
+                return;
+            }
+            actualColumnsToPrint.push_back(target);
+            columnsToPrint.push_back(table.column(target));
+        }
+    }
+
+    ResultWriter writer(tables.outputBuffer, tables.outputMode);
+    writer.header(actualColumnsToPrint);
+
+    // Filter and render the matching rows
+    forEachMatchingRow(isWherePresent ? &pattern : nullptr, table.numRows, [&](size_t rowIdx) {
+        writer.row(columnsToPrint, rowIdx);
+    });
+    writer.finish();
+}
+
+
+void truncateColumns(RowColumn<int> &table, size_t numRows) {
+    for (auto &column: table.columns) {
+        column.resize(numRows, defaultColumnValue(column.type));
+    }
+}
+
+void logAppendedRows(const string &tableName, const RowColumn<int> &table, size_t firstRow, size_t rows,
+                     Tables<int> &tables);
+
+/* Validates `newRows` rows that were appended to the columns of `tableName` past `numRows` and makes them part of
+ * the table. Registering the rows in the primary key index finds duplicates of stored rows and duplicates within the
+ * batch alike; every foreign key is a single probe per row into the referenced primary key index. On a violation the
+ * rows are removed from the index and the columns again and false is returned.
+ */
+bool commitAppendedRows(const string &tableName, size_t newRows, Tables<int> &tables) {
+    RowColumn<int> &table = tables.tables[tableName];
+    const size_t firstNewRow = table.numRows;
+
+    auto &index = tables.primaryKeyIndexes[tableName];
+    KeyColumns keyColumns = primaryKeyColumns(tableName, tables);
+    size_t indexedRows = 0;
+    auto rollback = [&] {
+        for (size_t i = 0; i < indexedRows; ++i) {
+            index.erase(keyColumns, static_cast<uint32_t>(firstNewRow + i));
+        }
+        truncateColumns(table, firstNewRow);
+    };
+
+    // --- Primary key check ---
+    if (!keyColumns.empty()) {
+        index.reserve(newRows);
+        for (; indexedRows < newRows; ++indexedRows) {
+            if (!index.insert(keyColumns, static_cast<uint32_t>(firstNewRow + indexedRows))) {
+                fmt::println("Composite primary key constraint violated! Duplicate entry.");
+                rollback();
+                return false;
+            }
+        }
+    }
+
+    // --- Foreign key check ---
+    // Referenced columns always form the primary key of the referenced table (see processForeignKey)
+    for (const auto &fk: tables.foreignKeys) {
+        if (fk.referencingTable != tableName) continue;
+
+        const auto &refSchema = tables.tables[fk.referencedTable].schema;
+
+        // The referencing columns in the order of the referenced primary key
+        KeyColumns referencingColumns;
+        for (size_t refOrdinal: refSchema.primaryKeyOrdinals) {
+            const auto &pk = refSchema.columns[refOrdinal].name;
+            auto position = find(fk.referencedColumns.begin(), fk.referencedColumns.end(), pk) -
+                            fk.referencedColumns.begin();
+            referencingColumns.push_back(&table.columns[table.schema.ordinals.at(fk.referencingColumns[position])]);
+        }
+
+        const auto &refIndex = tables.primaryKeyIndexes[fk.referencedTable];
+        KeyColumns refKeyColumns = primaryKeyColumns(fk.referencedTable, tables);
+        for (size_t row = firstNewRow; row < firstNewRow + newRows; ++row) {
+            if (refIndex.findRow(refKeyColumns, referencingColumns, static_cast<uint32_t>(row)) ==
+                PrimaryKeyIndex::emptySlot) {
+                fmt::println("Foreign key constraint failed: referencing values not found in referenced table '{}'.",
+                             fk.referencedTable);
+                rollback();
+                return false;
+            }
+        }
+    }
+
+    logAppendedRows(tableName, table, firstNewRow, newRows, tables);
+    table.numRows += newRows;
+    tables.markChanged(tableName);
+    return true;
+}
+
+
+/* insert into table ( columns ) values ( row ) [ ( row ) ... ]
+ *
+ * The column list is resolved once for all rows. Values are parsed column by column straight into the column
+ * buffers, which are reserved for the whole batch up front; the constraints are then checked for the whole batch by
+ * `commitAppendedRows`. The statement is all-or-nothing: on any error the appended rows are removed again.
+ */
+void processInsert(Tokens query, Tables<int> &tables) {
+    if (query.size() < 7 || query[0] != "insert" || query[1] != "into") {
+        fmt::println("Invalid insert statement.");
+        return;
+    }
+
+    string tableName(query[2]);
+
+    if (!tables.tables.contains(tableName)) {
+        fmt::println("Table '{}' does not exist.", tableName);
+        return;
+    }
+
+    RowColumn<int> &table = tables.tables[tableName];
+
+    // Parse column names inside parentheses
+    size_t startIdx = 3;
+    if (query[startIdx] != "(") {
+        fmt::println("Invalid insert statement.");
+        return;
+    }
+    size_t endIdx = startIdx + 1;
+    while (endIdx < query.size() && query[endIdx] != ")") ++endIdx;
+    if (endIdx + 1 >= query.size() || query[endIdx + 1] != "values") {
+        fmt::println("Invalid insert statement.");
+        return;
+    }
+
+    Tokens columnNames = query.subspan(startIdx + 1, endIdx - startIdx - 1);
+
+    // Every value list after `values` must hold one value per listed column
+    vector<size_t> rowStarts;
+    size_t idx = endIdx + 2;
+    while (idx < query.size()) {
+        if (query[idx] != "(") {
+            fmt::println("Invalid insert statement.");
+            return;
+        }
+        size_t rowEnd = idx + 1;
+        while (rowEnd < query.size() && query[rowEnd] != ")") ++rowEnd;
+        if (rowEnd - idx - 1 != columnNames.size()) {
+            fmt::println("{}", "there is mismatch in desired values to be inserted and predifined columns ");
+            return;
+        }
+        rowStarts.push_back(idx + 1);
+        idx = rowEnd + 1;
+    }
+    if (rowStarts.empty()) {
+        fmt::println("Invalid insert statement.");
+        return;
+    }
+
+    // Position of every column's value inside a value list
+    constexpr size_t notListed = SIZE_MAX;
+    vector<size_t> positionByOrdinal(table.schema.columns.size(), notListed);
+
+    for (size_t i = 0; i < columnNames.size(); i++) {
+        const ColumnSchema *columnSchema = table.schema.find(columnNames[i]);
+        if (!columnSchema) {
+            fmt::println("No such column '{}' in table '{}'", columnNames[i], tableName);
+            return;
+        }
+        positionByOrdinal[columnSchema->ordinal] = i;
+    }
+
+    for (const auto &columnSchema: table.schema.columns) {
+        if (positionByOrdinal[columnSchema.ordinal] == notListed) {
+            fmt::println("Column '{}' missing from insert statement.", columnSchema.name);
+            return;
+        }
+    }
+
+    const size_t firstNewRow = table.numRows;
+    const size_t newRows = rowStarts.size();
+
+    // ---- INSERT VALUES ----
+    for (size_t ordinal = 0; ordinal < table.columns.size(); ++ordinal) {
+        Column &column = table.columns[ordinal];
+        size_t position = positionByOrdinal[ordinal];
+        column.reserve(firstNewRow + newRows);
+        for (size_t rowStart: rowStarts) {
+            if (!column.appendText(tokenText(query[rowStart + position]))) {
+                fmt::println("Invalid value '{}' for column '{}'", tokenText(query[rowStart + position]),
+                             table.schema.columns[ordinal].name);
+                truncateColumns(table, firstNewRow);
+                return;
+            }
+        }
+    }
+
+    if (!commitAppendedRows(tableName, newRows, tables)) {
+        return;
+    }
+
+    if (newRows == 1) {
+        fmt::println("Inserted into table '{}'", tableName);
+    } else {
+        fmt::println("Inserted {} rows into table '{}'", newRows, tableName);
+    }
+}
+
+
+/* Applies `assignments`, which include a primary key column, to the rows matching `where` (all rows if null). The
+ * index is maintained per row: the old keys of the rows are erased and their new keys inserted. On the first
+ * duplicate the old cells and index entries are restored and the statement is rejected, as an insert is.
+ */
+bool updatePrimaryKeyRows(const string &tableName, const CompiledWhere *where,
+                          const vector<pair<Column *, ColumnValue>> &assignments, Tables<int> &tables) {
+    RowColumn<int> &table = tables.tables[tableName];
+    auto &index = tables.primaryKeyIndexes[tableName];
+    KeyColumns keyColumns = primaryKeyColumns(tableName, tables);
+
+    vector<uint32_t> rows;
+    forEachMatchingRow(where, table.numRows, [&rows](size_t row) { rows.push_back(static_cast<uint32_t>(row)); });
+
+    // The assigned cells before the update, per assignment and matched row
+    vector<vector<ColumnValue>> oldValues(assignments.size());
+    for (size_t i = 0; i < assignments.size(); ++i) {
+        oldValues[i].reserve(rows.size());
+        for (uint32_t row: rows) oldValues[i].push_back(assignments[i].first->value(row));
+    }
+
+    for (uint32_t row: rows) index.erase(keyColumns, row);
+    for (uint32_t row: rows) {
+        for (auto &[column, value]: assignments) column->set(row, value);
+    }
+
+    for (size_t inserted = 0; inserted < rows.size(); ++inserted) {
+        if (index.insert(keyColumns, rows[inserted])) continue;
+
+        for (size_t i = 0; i < inserted; ++i) index.erase(keyColumns, rows[i]);
+        for (size_t i = 0; i < assignments.size(); ++i) {
+            for (size_t r = 0; r < rows.size(); ++r) assignments[i].first->set(rows[r], oldValues[i][r]);
+        }
+        for (uint32_t row: rows) index.insert(keyColumns, row);
+        fmt::println("Composite primary key constraint violated! Duplicate entry.");
+        return false;
+    }
+    return true;
+}
+
+auto processUpdate(Tokens query, Tables<int> &tables) {
+    bool isWherePresent = false;
+    WherePattern pattern;
+    if (query.size() < 3 || query[0] != DBCommands::update || query[2] != "set") {
+        fmt::println("invalid update Format");
+        return;
+    }
+    string tableName(query[1]);
+
+    if (!tables.tables.contains(tableName)) {
+        fmt::println("no such table exist");
+        return;
+    }
+
+    int i = 3;
+    map<string, string_view> columnAndValue;
+    for (i; i < query.size(); i++) {
+        if (query[i] == DBCommands::where) {
+            isWherePresent = true;
+            if (!processWhereStatement(query, pattern)) return;
+            break;
+        }
+        if (query[i] == "=" && i + 1 < query.size()) {
+            columnAndValue[string(query[i - 1])] = tokenText(query[i + 1]);
+        }
+    }
+
+    RowColumn<int> &table = tables.tables[tableName];
+
+    // Convert the new values once, in the type of their column, and keep the target column by pointer
+    vector<pair<Column *, ColumnValue>> assignments;
+    bool assignsPrimaryKey = false;
+    for (const auto &item: columnAndValue) {
+        const ColumnSchema *columnSchema = table.schema.find(item.first);
+        if (!columnSchema) {
+            fmt::println("no such column in table {} ", tableName);
+            return;
+        }
+        ColumnValue value;
+        if (!parseColumnValue(item.second, columnSchema->type, value)) {
+            fmt::println("Invalid value '{}' for column '{}'", item.second, item.first);
+            return;
+        }
+        assignments.emplace_back(&table.columns[columnSchema->ordinal], std::move(value));
+        assignsPrimaryKey = assignsPrimaryKey || columnSchema->isPrimaryKey;
+    }
+
+    CompiledWhere compiledPattern;
+    if (isWherePresent && !compileWherePattern(pattern, table, compiledPattern)) {
+        return;
+    }
+
+
+    // Rows are rewritten in place, so the key index only changes if a key column is assigned
+    if (assignsPrimaryKey) {
+        if (!updatePrimaryKeyRows(tableName, isWherePresent ? &compiledPattern : nullptr, assignments, tables)) {
+            return;
+        }
+    } else if (!isWherePresent) {
+        for (auto &[column, value]: assignments) {
+            column->fill(value);
+        }
+    } else {
+        forEachMatchingRow(&compiledPattern, table.numRows, [&assignments](size_t rowIdx) {
+            for (auto &[column, value]: assignments) {
+                column->set(rowIdx, value);
+            }
+        });
+    }
+    tables.markChanged(tableName);
+}
+
+void processAdd(Tokens query, Tables<int> &tables, const string &tableName) {
+    string newColumnName(query[4]);
+    auto &table = tables.tables[tableName];
+    auto type = query[5];
+    ColumnType columnType;
+
+    if (table.schema.contains(newColumnName)) {
+        fmt::println("column {} already existst in table {} ", newColumnName, tableName);
+        return;
+    }
+
+    if (!parseColumnType(type, columnType)) {
+        fmt::println("unknown column type {} ", type);
+        return;
+    }
+
+    // String columns added later are filled with "null" for the existing rows
+    ColumnValue defaultValue = columnType == ColumnType::String ? ColumnValue("null") : defaultColumnValue(columnType);
+
+    // the new column is populated with default values for every existing row
+    table.addColumn(newColumnName, columnType, defaultValue);
+    tables.markChanged(tableName);
+}
+
+void processForeignKey(Tokens query, Tables<int> &tables, const string &tableName) {
+    vector<string> referencingColumns;
+    vector<string> referencedColumns;
+
+
+    string referencedTable;
+
+    bool inReferencingColumns = false;
+    bool inReferencedColumns = false;
+
+    for (size_t i = 0; i < query.size(); ++i) {
+        if (query[i] == "foreign" && i + 1 < query.size() && query[i + 1] == "key") {
+            inReferencingColumns = true;
+            i += 2;
+            continue;
+        }
+
+        if (inReferencingColumns && query[i] == "(") continue;
+        if (inReferencingColumns && query[i] == ")") {
+            inReferencingColumns = false;
+            continue;
+        }
+        if (inReferencingColumns) {
+            referencingColumns.emplace_back(query[i]);
+            continue;
+        }
+
+        if (query[i] == "references" && i + 1 < query.size()) {
+            referencedTable = query[++i];
+            inReferencedColumns = true;
+            continue;
+        }
+
+        if (inReferencedColumns && query[i] == "(") continue;
+        if (inReferencedColumns && query[i] == ")") {
+            inReferencedColumns = false;
+            continue;
+        }
+        if (inReferencedColumns) {
+            referencedColumns.emplace_back(query[i]);
+        }
+    }
+
+    for (const auto &fk: tables.foreignKeys) {
+        if (fk.referencingTable == tableName &&
+            fk.referencedTable == referencedTable &&
+            fk.referencingColumns == referencingColumns &&
+            fk.referencedColumns == referencedColumns) {
+            fmt::println("This foreign key relationship already exists.");
+            return;
+        }
+    }
+
+    //  Check existence of referenced table
+    if (!tables.tables.contains(referencedTable)) {
+        fmt::println("Table '{}' does not exist.", referencedTable);
+        return;
+    }
+
+    //  Check if referenced columns exist in referenced table
+    for (const auto &col: referencedColumns) {
+        if (!tables.tables[referencedTable].schema.contains(col)) {
+            fmt::println("Referenced column '{}' does not exist in table '{}'.", col, referencedTable);
+            return;
+        }
+    }
+
+    //  Check if referencing columns exist in referencing table
+    for (const auto &col: referencingColumns) {
+        if (!tables.tables[tableName].schema.contains(col)) {
+            fmt::println("Referencing column '{}' does not exist in table '{}'.", col, tableName);
+            return;
+        }
+    }
+
+    // Check that types of referencing and referenced columns match
+    for (size_t i = 0; i < min(referencingColumns.size(), referencedColumns.size()); ++i) {
+        const auto &referencingCol = *tables.tables[tableName].schema.find(referencingColumns[i]);
+        const auto &referencedCol = *tables.tables[referencedTable].schema.find(referencedColumns[i]);
+
+        if (referencingCol.type != referencedCol.type) {
+            fmt::println(
+                    "Type mismatch: referencing column '{}' and referenced column '{}' must be of the same type.",
+                    referencingColumns[i], referencedColumns[i]);
+            return;
+        }
+    }
+
+
+    // : Check if referenced columns match the primary key of the referenced table
+    auto pkOfReferenced = tables.primaryKeys[referencedTable];
+    vector<string> sortedReferenced = referencedColumns;
+    vector<string> sortedPK = pkOfReferenced;
+
+    sort(sortedReferenced.begin(), sortedReferenced.end());
+    sort(sortedPK.begin(), sortedPK.end());
+
+    if (sortedReferenced != sortedPK) {
+        fmt::println("Referenced columns do not match the primary key of '{}'.", referencedTable);
+        return;
+    }
+
+    // Step 5: Ensure sizes match (number of columns)
+    if (referencingColumns.size() != referencedColumns.size()) {
+        fmt::println("Mismatched column count in referencing and referenced keys.");
+        return;
+    }
+
+    // Step 6: Save the foreign key definition
+    ForeignKey foreignKey = ForeignKey(tableName, referencingColumns, referencedTable, referencedColumns);
+    tables.foreignKeys.push_back(foreignKey);
+    tables.markChanged(tableName);
+}
+
+void alterTableDropColumn(Tokens query, Tables<int> &tables, const string &tableName) {
+
+    string columnToDrop(query[4]);
+
+
+    if (!tables.tables.contains(tableName)) {
+        fmt::println("Table '{}' does not exist.", tableName);
+        return;
+    }
+
+    RowColumn<int> &table = tables.tables[tableName];
+
+
+    if (!table.schema.contains(columnToDrop)) {
+        fmt::println("Column '{}' does not exist in table '{}'.", columnToDrop, tableName);
+        return;
+    }
+
+
+    auto &pkCols = tables.primaryKeys[tableName];
+    if (find(pkCols.begin(), pkCols.end(), columnToDrop) != pkCols.end()) {
+        fmt::println("Cannot drop column '{}': it is part of the primary key.", columnToDrop);
+        return;
+    }
+
+
+    for (const auto &fk: tables.foreignKeys) {
+        if ((fk.referencingTable == tableName &&
+             find(fk.referencingColumns.begin(), fk.referencingColumns.end(), columnToDrop) !=
+             fk.referencingColumns.end()) ||
+            (fk.referencedTable == tableName &&
+             find(fk.referencedColumns.begin(), fk.referencedColumns.end(), columnToDrop) !=
+             fk.referencedColumns.end())) {
+            fmt::println("Cannot drop column '{}': it is part of a foreign key relationship.", columnToDrop);
+            return;
+        }
+    }
+
+
+    table.dropColumn(columnToDrop);
+    tables.markChanged(tableName);
+    fmt::println("Column '{}' dropped from table '{}'.", columnToDrop, tableName);
+}
+
+void dropTable(Tokens query, Tables<int> &tables) {
+    if (query.size() < 3 || query[0] != "drop" || query[1] != "table") {
+        fmt::println("Incorrect drop table syntax. Expected: DROP TABLE <tableName>");
+        return;
+    }
+
+    string tableName(query[2]);
+
+    if (!tables.tables.contains(tableName)) {
+        fmt::println("Table '{}' does not exist.", tableName);
+        return;
+    }
+
+
+    deleteTable(tableName, tables);
+    tables.primaryKeys.erase(tableName);
+
+    erase_if(tables.foreignKeys, [&tableName](ForeignKey key) {
+        return key.referencedTable == tableName || key.referencingTable == tableName;
+    });
+    tables.markChanged(tableName);
+
+    fmt::println("Table '{}' dropped successfully.", tableName);
+}
+
+
+void processAlter(Tokens query, Tables<int> &tables) {
+    string tableName(query[2]);
+
+    if (!tables.tables.contains(tableName)) {
+        fmt::println("Table '{}' does not exist.", tableName);
+        return;
+    }
+
+    //start processing from index 3
+    for (int i = 3; i < query.size(); i++) {
+        if (query[i] == DBCommands::add) {
+            processAdd(query, tables, tableName);
+        }
+        if (query[i] == DBCommands::drop) {
+            alterTableDropColumn(query, tables, tableName);
+        }
+        if (query[i] == DBCommands::foreign) {
+            processForeignKey(query, tables, tableName);
+        }
+    }
+
+}
+
+
+// Read-only view of a whole file: mapped on POSIX systems, read into memory elsewhere
+class MappedFile {
+public:
+    // `sequential` tells the OS the file will be read front to back, otherwise pages are faulted in on demand
+    explicit MappedFile(const string &path, bool sequential = true) {
+#ifdef _WIN32
+        (void) sequential;
+        ifstream file(path, ios::binary);
+        if (!file.is_open()) return;
+        contents.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+        text = contents;
+        opened = true;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return;
+        struct stat info{};
+        if (fstat(fd, &info) == 0) {
+            opened = true;
+            if (info.st_size > 0) {
+                void *address = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (address == MAP_FAILED) {
+                    opened = false;
+                } else {
+                    madvise(address, info.st_size, sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+                    mapping = address;
+                    text = string_view(static_cast<const char *>(address), info.st_size);
+                }
+            }
+        }
+        ::close(fd);
+#endif
+    }
+
+    ~MappedFile() {
+#ifndef _WIN32
+        if (mapping) munmap(mapping, text.size());
+#endif
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    bool isOpen() const { return opened; }
+
+    string_view view() const { return text; }
+
+private:
+    bool opened = false;
+    string_view text;
+#ifdef _WIN32
+    string contents;
+#else
+    void *mapping = nullptr;
+#endif
+};
+
+// Forces the data written to `fd` to disk
+bool syncFile(int fd) {
+#ifdef _WIN32
+    return _commit(fd) == 0;
+#elif defined(__APPLE__)
+    return fsync(fd) == 0;
+#else
+    return fdatasync(fd) == 0;
+#endif
+}
+
+// Makes renames inside `directory` durable; Windows has no equivalent and needs none
+bool syncDirectory(const string &directory) {
+#ifdef _WIN32
+    (void) directory;
+    return true;
+#else
+    int fd = ::open(directory.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    bool synced = fsync(fd) == 0;
+    ::close(fd);
+    return synced;
+#endif
+}
+
+/* -- Snapshots:
+ *
+ *     save path.snap
+ *     load path.snap
+ *
+ * A snapshot is a binary image of the whole database that is restored without replaying or re-validating anything:
+ *
+ *     header   magic, format version, byte order mark, hash probe, position and checksum of the catalog, and
+ *              the epoch of the write-ahead log that continues the snapshot
+ *     blocks   raw buffers at 8-byte aligned offsets: int and float cells as they are stored in memory; for string
+ *              columns numRows + 1 uint64 offsets followed by the concatenated bytes; the slots of each primary key index
+ *     catalog  the names of other snapshot files in the same directory that hold blocks of this one; tables (the
+ *              file holding the blocks, name, row count, columns with name, type and block, primary key columns,
+ *              index block) and foreign keys; strings are a uint32 length followed by the bytes
+ *
+ * Only snapshots of the current format version are read.
+ *
+ * A snapshot written by `save` holds all of its blocks. The checkpoints of a data directory only write the tables
+ * that changed and refer to the blocks of the others in the files written before (see processCheckpoint).
+ *
+ * Every block and the catalog carry a checksum. Index slots hold hashes of the key values, so they are only reused
+ * when the hash probe in the header matches this build; otherwise the indexes are rebuilt from the loaded columns.
+ * A snapshot is written to `path.tmp` first and renamed, so a crash during `save` keeps the previous snapshot.
+ */
+constexpr array<char, 8> snapshotMagic{'P', 'J', 'C', 'S', 'N', 'A', 'P', '\0'};
+constexpr uint32_t snapshotVersion = 3;
+constexpr uint32_t snapshotByteOrder = 0x01020304;
+
+struct SnapshotHeader {
+    array<char, 8> magic = snapshotMagic;
+    uint32_t version = snapshotVersion;
+    uint32_t byteOrder = snapshotByteOrder;
+    uint64_t hashProbe = 0;
+    uint64_t catalogOffset = 0;
+    uint64_t catalogSize = 0;
+    uint64_t catalogChecksum = 0;
+    uint64_t walEpoch = 0;  // snapshots written by `save` use 0
+};
+
+struct SnapshotBlock {
+    uint64_t offset = 0;
+    uint64_t size = 0;
+    uint64_t checksum = 0;
+};
+
+// 64-bit checksum, eight bytes per step in four independent lanes so it runs at memory speed
+uint64_t checksum64(const char *data, size_t size) {
+    constexpr uint64_t prime1 = 0x9E3779B185EBCA87ULL;
+    constexpr uint64_t prime2 = 0xC2B2AE3D27D4EB4FULL;
+    uint64_t lanes[4] = {prime1 + prime2, prime2, 0, ~prime1};
+
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        for (size_t lane = 0; lane < 4; ++lane) {
+            uint64_t word;
+            memcpy(&word, data + i + lane * 8, 8);
+            lanes[lane] = rotl(lanes[lane] + word * prime2, 31) * prime1;
+        }
+    }
+
+    uint64_t result = size;
+    for (uint64_t lane: lanes) result = combineHash(result, lane);
+    for (; i < size; ++i) result = (result ^ static_cast<unsigned char>(data[i])) * prime1;
+    return result ^ (result >> 29);
+}
+
+// Changes whenever the build hashes key values differently
+uint64_t snapshotHashProbe() {
+    uint64_t probe = hashColumnValue(ColumnValue(12345));
+    probe = combineHash(probe, hashColumnValue(ColumnValue(1.5f)));
+    return combineHash(probe, hashColumnValue(ColumnValue(string("snapshot"))));
+}
+
+class SnapshotWriter {
+public:
+    explicit SnapshotWriter(FILE *out) : out(out) {}
+
+    // Writes `size` bytes at the next 8-byte aligned offset
+    SnapshotBlock block(const void *data, size_t size) {
+        static const char padding[8] = {};
+        write(padding, (8 - position % 8) % 8);
+        SnapshotBlock result{position, size, checksum64(static_cast<const char *>(data), size)};
+        write(data, size);
+        return result;
+    }
+
+    void write(const void *data, size_t size) {
+        if (size > 0 && fwrite(data, 1, size, out) != size) failed = true;
+        position += size;
+    }
+
+    uint64_t position = 0;
+    bool failed = false;
+
+private:
+    FILE *out;
+};
+
+// Catalog encoding
+void putU32(string &out, uint32_t value) { out.append(reinterpret_cast<const char *>(&value), sizeof(value)); }
+
+void putU64(string &out, uint64_t value) { out.append(reinterpret_cast<const char *>(&value), sizeof(value)); }
+
+void putString(string &out, string_view value) {
+    putU32(out, static_cast<uint32_t>(value.size()));
+    out.append(value);
+}
+
+void putBlock(string &out, const SnapshotBlock &block) {
+    putU64(out, block.offset);
+    putU64(out, block.size);
+    putU64(out, block.checksum);
+}
+
+void putStrings(string &out, const vector<string> &values) {
+    putU32(out, static_cast<uint32_t>(values.size()));
+    for (const auto &value: values) putString(out, value);
+}
+
+// Reads the catalog; any read past the end marks the reader as failed and returns zeros
+class SnapshotReader {
+public:
+    explicit SnapshotReader(string_view data) : data(data) {}
+
+    bool ok() const { return valid; }
+
+    size_t position() const { return pos; }
+
+    uint32_t u32() { return read<uint32_t>(); }
+
+    uint64_t u64() { return read<uint64_t>(); }
+
+    string str() { return string(bytes(u32())); }
+
+    string_view bytes(uint64_t size) {
+        if (!valid || size > data.size() - pos) {
+            valid = false;
+            return {};
+        }
+        string_view result = data.substr(pos, size);
+        pos += size;
+        return result;
+    }
+
+    vector<string> strings() {
+        vector<string> result(u32());
+        for (auto &value: result) value = str();
+        return result;
+    }
+
+    SnapshotBlock block() {
+        SnapshotBlock result;
+        result.offset = u64();
+        result.size = u64();
+        result.checksum = u64();
+        return result;
+    }
+
+private:
+    string_view data;
+    size_t pos = 0;
+    bool valid = true;
+
+    template<typename V>
+    V read() {
+        V value{};
+        if (!valid || sizeof(V) > data.size() - pos) {
+            valid = false;
+            return value;
+        }
+        memcpy(&value, data.data() + pos, sizeof(V));
+        pos += sizeof(V);
+        return value;
+    }
+};
+
+// Appends the cells [firstRow, firstRow + rows) of `column` in the layout of a column block
+void appendColumnCells(string &out, const Column &column, size_t firstRow, size_t rows) {
+    switch (column.type) {
+        case ColumnType::Int: {
+            vector<int32_t> cells(rows);
+            column.ints.copyTo(firstRow, rows, cells.data());
+            out.append(reinterpret_cast<const char *>(cells.data()), rows * sizeof(int32_t));
+            return;
+        }
+        case ColumnType::Float: {
+            vector<float> cells(rows);
+            column.floats.copyTo(firstRow, rows, cells.data());
+            out.append(reinterpret_cast<const char *>(cells.data()), rows * sizeof(float));
+            return;
+        }
+        case ColumnType::String: {
+            uint64_t offset = 0;
+            putU64(out, offset);
+            for (size_t row = firstRow; row < firstRow + rows; ++row) {
+                offset += column.strings[row].size();
+                putU64(out, offset);
+            }
+            out.reserve(out.size() + offset);
+            for (size_t row = firstRow; row < firstRow + rows; ++row) {
+                out.append(column.strings[row]);
+            }
+            return;
+        }
+    }
+}
+
+SnapshotBlock writeColumnBlock(SnapshotWriter &writer, const Column &column, size_t numRows) {
+    string blob;
+    appendColumnCells(blob, column, 0, numRows);
+    return writer.block(blob.data(), blob.size());
+}
+
+/* Writes the tables of `tables` to the snapshot `filePath`. The tables in `stored` are not written again: the catalog
+ * refers to their blocks in the earlier files of the same directory. On success `stored` is extended by the tables
+ * written to this file.
+ */
+bool processSaveSnapshot(const string &filePath, Tables<int> &tables, uint64_t walEpoch = 0,
+                         SnapshotTables *stored = nullptr) {
+    auto start = chrono::steady_clock::now();
+    string tempPath = filePath + ".tmp";
+    FILE *out = fopen(tempPath.c_str(), "wb");
+    if (!out) {
+        fmt::println("Could not open file '{}'", tempPath);
+        return false;
+    }
+
+    SnapshotHeader header;
+    header.hashProbe = snapshotHashProbe();
+    header.walEpoch = walEpoch;
+    SnapshotWriter writer(out);
+    writer.write(&header, sizeof(header));
+
+    // Other files are numbered from 1 in the catalog, 0 is this file
+    vector<string> files;
+    map<string, uint32_t> fileNumbers;
+    SnapshotTables noneStored;
+    SnapshotTables &reused = stored ? *stored : noneStored;
+    for (const auto &[tableName, location]: reused) {
+        if (fileNumbers.contains(location.file)) continue;
+        files.push_back(location.file);
+        fileNumbers[location.file] = static_cast<uint32_t>(files.size());
+    }
+
+    string catalog;
+    putStrings(catalog, files);
+    putU64(catalog, tables.tables.size() + reused.size());
+    SnapshotTables written;
+    string fileName = filesystem::path(filePath).filename().string();
+    for (const auto &[tableName, table]: tables.tables) {
+        putU32(catalog, 0);
+        size_t entryStart = catalog.size();
+        putString(catalog, tableName);
+        putU64(catalog, table.numRows);
+        putU32(catalog, static_cast<uint32_t>(table.schema.columns.size()));
+        for (const auto &columnSchema: table.schema.columns) {
+            putString(catalog, columnSchema.name);
+            putU32(catalog, static_cast<uint32_t>(columnSchema.type));
+            putBlock(catalog, writeColumnBlock(writer, table.columns[columnSchema.ordinal], table.numRows));
+        }
+
+        auto primaryKey = tables.primaryKeys.find(tableName);
+        putStrings(catalog, primaryKey == tables.primaryKeys.end() ? vector<string>() : primaryKey->second);
+        const auto &index = tables.primaryKeyIndexes[tableName];
+        putU64(catalog, index.count);
+        vector<PrimaryKeyIndex::Slot> slots(index.slots.size());
+        index.slots.copyTo(0, slots.size(), slots.data());
+        putBlock(catalog, writer.block(slots.data(), slots.size() * sizeof(PrimaryKeyIndex::Slot)));
+        written[tableName] = {fileName, catalog.substr(entryStart)};
+    }
+    for (const auto &[tableName, location]: reused) {
+        putU32(catalog, fileNumbers[location.file]);
+        catalog += location.entry;
+    }
+
+    putU32(catalog, static_cast<uint32_t>(tables.foreignKeys.size()));
+    for (const auto &fk: tables.foreignKeys) {
+        putString(catalog, fk.referencingTable);
+        putStrings(catalog, fk.referencingColumns);
+        putString(catalog, fk.referencedTable);
+        putStrings(catalog, fk.referencedColumns);
+    }
+
+    SnapshotBlock catalogBlock = writer.block(catalog.data(), catalog.size());
+    header.catalogOffset = catalogBlock.offset;
+    header.catalogSize = catalogBlock.size;
+    header.catalogChecksum = catalogBlock.checksum;
+
+    bool failed = writer.failed || fseek(out, 0, SEEK_SET) != 0 || fwrite(&header, sizeof(header), 1, out) != 1;
+    failed = fflush(out) != 0 || !syncFile(fileno(out)) || failed;
+    failed = fclose(out) != 0 || failed;
+    error_code error;
+    if (!failed) filesystem::rename(tempPath, filePath, error);
+    if (failed || error) {
+        filesystem::remove(tempPath, error);
+        fmt::println("Could not write snapshot '{}'", filePath);
+        return false;
+    }
+
+    double seconds = max(chrono::duration<double>(chrono::steady_clock::now() - start).count(), 1e-9);
+    if (reused.empty()) {
+        fmt::println("Snapshot of {} tables saved to '{}' ({:.1f} MB in {:.2f}s)", tables.tables.size(), filePath,
+                     writer.position / 1e6, seconds);
+    } else {
+        fmt::println("Snapshot saved to '{}': {} changed tables written, {} unchanged ({:.1f} MB in {:.2f}s)",
+                     filePath, tables.tables.size(), reused.size(), writer.position / 1e6, seconds);
+    }
+    reused.merge(written);
+    return true;
+}
+
+bool isSnapshotFile(const string &path) {
+    ifstream file(path, ios::binary);
+    array<char, 8> magic{};
+    return file.read(magic.data(), magic.size()) && magic == snapshotMagic;
+}
+
+// The bytes of `block` if it lies inside the file and, when `verify` is set, its checksum matches
+bool snapshotBlockData(string_view file, const SnapshotBlock &block, bool verify, string_view &data) {
+    if (block.offset % 8 != 0 || block.offset > file.size() || block.size > file.size() - block.offset) return false;
+    data = file.substr(block.offset, block.size);
+    return !verify || checksum64(data.data(), data.size()) == block.checksum;
+}
+
+/* Fills `column` from its snapshot block: copied, or for an opened snapshot pointed at the mapping itself. Opened
+ * string columns are only checked at their ends, so opening never touches more than the first and last page.
+ */
+bool loadColumnBlock(string_view data, size_t numRows, Column &column, const shared_ptr<const MappedFile> &mapping) {
+    switch (column.type) {
+        case ColumnType::Int: {
+            if (data.size() != numRows * sizeof(int32_t)) return false;
+            const auto *cells = reinterpret_cast<const int32_t *>(data.data());
+            if (mapping) {
+                column.ints.map(cells, numRows, mapping);
+            } else {
+                column.ints.assign(cells, numRows);
+            }
+            return true;
+        }
+        case ColumnType::Float: {
+            if (data.size() != numRows * sizeof(float)) return false;
+            const auto *cells = reinterpret_cast<const float *>(data.data());
+            if (mapping) {
+                column.floats.map(cells, numRows, mapping);
+            } else {
+                column.floats.assign(cells, numRows);
+            }
+            return true;
+        }
+        case ColumnType::String: {
+            size_t offsetsSize = (numRows + 1) * sizeof(uint64_t);
+            if (data.size() < offsetsSize) return false;
+            const auto *offsets = reinterpret_cast<const uint64_t *>(data.data());
+            string_view bytes = data.substr(offsetsSize);
+            if (offsets[0] != 0 || offsets[numRows] != bytes.size()) return false;
+            if (mapping) {
+                column.strings.map(offsets, bytes.data(), numRows, mapping);
+                return true;
+            }
+
+            column.strings.reserve(numRows);
+            for (size_t row = 0; row < numRows; ++row) {
+                if (offsets[row + 1] < offsets[row] || offsets[row + 1] > bytes.size()) return false;
+                column.strings.push_back(bytes.substr(offsets[row], offsets[row + 1] - offsets[row]));
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/* Replaces the whole database with the snapshot at `path`. Everything is checked and loaded into new containers
+ * first, so a damaged snapshot leaves the current state untouched.
+ *
+ * `load` copies every buffer out of the file and verifies its checksum. `open` points the columns and indexes into
+ * the mapping instead, without reading the blocks: the OS faults pages in as queries touch them, processes opening
+ * the same snapshot share them in the page cache, and a column or index is copied into memory only when an insert
+ * or update modifies it.
+ *
+ * `origin`, if given, receives the write-ahead log epoch recorded in the snapshot and where each table is stored. With
+ * a log attached, the new state is checkpointed before anything else is logged, since the log only describes changes
+ * to the previous one (see processCheckpoint).
+ */
+struct SnapshotOrigin {
+    uint64_t walEpoch = 0;
+    SnapshotTables tables;
+};
+
+void processCheckpoint(Tables<int> &tables, bool replaced = false);
+
+bool processLoadSnapshot(const string &path, bool open, Tables<int> &tables, SnapshotOrigin *origin = nullptr) {
+    auto start = chrono::steady_clock::now();
+    auto file = make_shared<const MappedFile>(path, !open);
+    string_view text = file->view();
+
+    SnapshotHeader header;
+    if (!file->isOpen() || text.size() < sizeof(header)) {
+        fmt::println("Could not read snapshot '{}'", path);
+        return false;
+    }
+    memcpy(&header, text.data(), sizeof(header));
+    if (header.magic != snapshotMagic || header.byteOrder != snapshotByteOrder) {
+        fmt::println("'{}' is not a snapshot of this platform", path);
+        return false;
+    }
+    if (header.version != snapshotVersion) {
+        fmt::println("Snapshot '{}' has format version {}, expected {}", path, header.version, snapshotVersion);
+        return false;
+    }
+
+    string_view catalogData;
+    if (!snapshotBlockData(text, {header.catalogOffset, header.catalogSize, header.catalogChecksum}, true,
+                           catalogData)) {
+        fmt::println("Snapshot '{}' is damaged: catalog checksum mismatch", path);
+        return false;
+    }
+
+    bool reuseIndexes = header.hashProbe == snapshotHashProbe();
+    map<string, RowColumn<int>> loadedTables;
+    map<string, vector<string>> loadedPrimaryKeys;
+    map<string, PrimaryKeyIndex> loadedIndexes;
+    vector<ForeignKey> loadedForeignKeys;
+    SnapshotTables loadedLocations;
+    auto damaged = [&](string_view what) {
+        fmt::println("Snapshot '{}' is damaged: {}", path, what);
+    };
+
+    SnapshotReader catalog(catalogData);
+    vector<string> fileNames{filesystem::path(path).filename().string()};
+    vector<shared_ptr<const MappedFile>> files{file};
+    size_t totalSize = text.size();
+    for (string &name: catalog.strings()) {
+        auto other = make_shared<const MappedFile>((filesystem::path(path).parent_path() / name).string(), !open);
+        if (!other->isOpen()) {
+            damaged(fmt::format("missing file '{}'", name));
+            return false;
+        }
+        fileNames.push_back(std::move(name));
+        files.push_back(std::move(other));
+        totalSize += files.back()->view().size();
+    }
+
+    uint64_t tableCount = catalog.u64();
+    for (uint64_t t = 0; t < tableCount && catalog.ok(); ++t) {
+        uint32_t source = catalog.u32();
+        if (source >= files.size()) {
+            damaged("unknown file");
+            return false;
+        }
+        string_view blocks = files[source]->view();
+        shared_ptr<const MappedFile> mapping = open ? files[source] : nullptr;
+        size_t entryStart = catalog.position();
+
+        string tableName = catalog.str();
+        RowColumn<int> &table = loadedTables[tableName];
+        table.numRows = catalog.u64();
+        uint32_t columnCount = catalog.u32();
+        for (uint32_t c = 0; c < columnCount && catalog.ok(); ++c) {
+            string columnName = catalog.str();
+            uint32_t type = catalog.u32();
+            SnapshotBlock block = catalog.block();
+            string_view data;
+            if (type > static_cast<uint32_t>(ColumnType::String) || table.schema.contains(columnName)) {
+                damaged(fmt::format("invalid column '{}' in table '{}'", columnName, tableName));
+                return false;
+            }
+            table.schema.add(columnName, static_cast<ColumnType>(type));
+            Column &column = table.columns.emplace_back(static_cast<ColumnType>(type));
+            if (!snapshotBlockData(blocks, block, !open, data) ||
+                !loadColumnBlock(data, table.numRows, column, mapping)) {
+                damaged(fmt::format("column '{}' of table '{}'", columnName, tableName));
+                return false;
+            }
+        }
+
+        vector<string> primaryKey = catalog.strings();
+        for (const auto &name: primaryKey) {
+            if (!table.schema.contains(name)) {
+                damaged(fmt::format("unknown primary key column '{}' in table '{}'", name, tableName));
+                return false;
+            }
+        }
+        table.schema.setPrimaryKey(primaryKey);
+        if (!primaryKey.empty()) loadedPrimaryKeys[tableName] = std::move(primaryKey);
+
+        uint64_t indexCount = catalog.u64();
+        SnapshotBlock indexBlock = catalog.block();
+        string_view indexData;
+        if (!snapshotBlockData(blocks, indexBlock, !open, indexData)) {
+            damaged(fmt::format("primary key index of table '{}'", tableName));
+            return false;
+        }
+        PrimaryKeyIndex &index = loadedIndexes[tableName];
+        size_t slotCount = indexData.size() / sizeof(PrimaryKeyIndex::Slot);
+        if (reuseIndexes && indexData.size() % sizeof(PrimaryKeyIndex::Slot) == 0 && has_single_bit(slotCount) &&
+            indexCount == table.numRows) {
+            const auto *slots = reinterpret_cast<const PrimaryKeyIndex::Slot *>(indexData.data());
+            if (open) {
+                index.slots.map(slots, slotCount, mapping);
+            } else {
+                index.slots.assign(slots, slotCount);
+            }
+            index.count = indexCount;
+        } else {
+            KeyColumns keyColumns;
+            for (size_t ordinal: table.schema.primaryKeyOrdinals) keyColumns.push_back(&table.columns[ordinal]);
+            if (!keyColumns.empty()) index.rebuild(keyColumns, 0, table.numRows);
+        }
+        loadedLocations[tableName] = {fileNames[source],
+                                      string(catalogData.substr(entryStart, catalog.position() - entryStart))};
+    }
+
+    uint32_t foreignKeyCount = catalog.u32();
+    for (uint32_t i = 0; i < foreignKeyCount && catalog.ok(); ++i) {
+        ForeignKey &fk = loadedForeignKeys.emplace_back();
+        fk.referencingTable = catalog.str();
+        fk.referencingColumns = catalog.strings();
+        fk.referencedTable = catalog.str();
+        fk.referencedColumns = catalog.strings();
+    }
+
+    if (!catalog.ok()) {
+        damaged("truncated catalog");
+        return false;
+    }
+
+    tables.tables = std::move(loadedTables);
+    tables.primaryKeys = std::move(loadedPrimaryKeys);
+    tables.primaryKeyIndexes = std::move(loadedIndexes);
+    tables.foreignKeys = std::move(loadedForeignKeys);
+
+    double seconds = max(chrono::duration<double>(chrono::steady_clock::now() - start).count(), 1e-9);
+    fmt::println("Snapshot '{}' {}: {} tables, {:.1f} MB in {:.2f}s{}", path, open ? "opened" : "loaded",
+                 tables.tables.size(), totalSize / 1e6, seconds, reuseIndexes ? "" : " (primary key indexes rebuilt)");
+
+    ++tables.changes;
+    tables.snapshotTables.clear();
+    if (origin) {
+        origin->walEpoch = header.walEpoch;
+        origin->tables = std::move(loadedLocations);
+    }
+    if (tables.wal) processCheckpoint(tables, true);
+    return true;
+}
+
+
+// open <path.snap>: see processLoadSnapshot
+void processOpen(Tokens query, Tables<int> &tables) {
+    if (query.size() != 2) {
+        fmt::println("usage: open <snapshot>");
+        return;
+    }
+
+    string path(tokenText(query[1]));
+    if (!isSnapshotFile(path)) {
+        fmt::println("'{}' is not a snapshot", path);
+        return;
+    }
+    processLoadSnapshot(path, true, tables);
+}
+
+/* -- Write-ahead log:
+ *
+ *     program <data directory>
+ *     set sync always | group [milliseconds] | off
+ *     checkpoint
+ *
+ * Started with a data directory, the program keeps the database in snapshot files and write-ahead logs, both
+ * numbered by epoch: `snapshot-N.snap` is the state in which `wal-N.log` starts. At startup the newest snapshot is
+ * loaded and the logs from its epoch on are replayed on top; from then on every change is appended to the log of
+ * the current epoch.
+ *
+ * The log holds what is cheapest to log and exact to replay: `create`, `alter`, `drop` and `update` as their tokens,
+ * which replay deterministically on the same state, and rows added by `insert` and `copy` as binary column images of
+ * the appended rows (the layout of snapshot column blocks), so replaying a bulk load does not parse text again.
+ * A large batch is logged in pieces of at most `walRecordRows` rows and `walRecordMaxBytes`: every piece but the
+ * last is a RowsPart record, and replay commits the batch only with its final Rows record.
+ *
+ *     header   magic, format version, byte order mark, epoch
+ *     records  uint32 payload size, uint32 kind, checksum of the payload, payload
+ *
+ * Replay stops at the first torn or damaged record and cuts it off, together with the parts of a batch whose final
+ * record is missing.
+ *
+ * How records reach the disk is set with `set sync`:
+ *
+ *     always   every statement is written and synced before the next one runs
+ *     group    records are buffered and a background thread writes and syncs them every few milliseconds (default),
+ *              so a crash loses at most the last interval while statements never wait for the disk
+ *     off      the background thread writes without syncing; the OS decides when the data is persisted
+ *
+ * Checkpoints run in the background. `checkpoint`, `exit`, `load` or `open` of a snapshot and a log growing past
+ * `checkpointLogSize` start one: the statement thread switches the log to the next epoch and takes copies of the
+ * tables that changed since the last checkpoint (see Tables::markChanged), which share their cells with the live
+ * tables until these modify them, a row group at a time (see ChunkedBuffer); a background thread writes them to the
+ * snapshot of the new epoch, whose catalog refers to the unchanged tables in the files written before, and then
+ * deletes the logs and snapshot files that are no longer needed. A checkpoint costs in proportion to the change, not
+ * to the database.
+ * After `load` or `open` the snapshot is written before the log switches, see processCheckpoint.
+ */
+constexpr array<char, 8> walMagic{'P', 'J', 'C', 'W', 'A', 'L', '\0', '\0'};
+constexpr uint32_t walVersion = 1;
+constexpr auto walDefaultGroupInterval = chrono::milliseconds(10);
+constexpr size_t walRecordRows = 1 << 16;
+constexpr size_t walRecordMaxBytes = 256 << 20;
+constexpr size_t walPendingMaxBytes = 64 << 20;  // buffered records beyond this are written by the appending thread
+constexpr size_t checkpointLogSize = 256 << 20;
+
+string snapshotFileName(uint64_t epoch) { return fmt::format("snapshot-{}.snap", epoch); }
+
+string walFileName(uint64_t epoch) { return fmt::format("wal-{}.log", epoch); }
+
+// The epoch of a file named `prefix` N `suffix`
+bool parseEpochFileName(string_view name, string_view prefix, string_view suffix, uint64_t &epoch) {
+    if (!name.starts_with(prefix) || !name.ends_with(suffix) || name.size() == prefix.size() + suffix.size()) {
+        return false;
+    }
+    string_view digits = name.substr(prefix.size(), name.size() - prefix.size() - suffix.size());
+    auto [end, error] = from_chars(digits.data(), digits.data() + digits.size(), epoch);
+    return error == errc() && end == digits.data() + digits.size();
+}
+
+struct WalHeader {
+    array<char, 8> magic = walMagic;
+    uint32_t version = walVersion;
+    uint32_t byteOrder = snapshotByteOrder;
+    uint64_t epoch = 0;
+};
+
+enum class WalRecordKind : uint32_t {
+    Statement = 1,  // uint32 token count, tokens as strings
+    Rows = 2,       // table name, uint64 row count, uint32 column count, per column uint32 type and uint64 sized cells
+    RowsPart = 3    // as Rows, for a piece of a batch that the following records complete
+};
+
+struct WalRecordHeader {
+    uint32_t size = 0;
+    WalRecordKind kind = WalRecordKind::Statement;
+    uint64_t checksum = 0;
+};
+
+enum class SyncMode : uint8_t {
+    Always,
+    Group,
+    Off
+};
+
+// An append-only file descriptor: POSIX calls, or their <io.h> counterparts on Windows
+class LogFile {
+public:
+    LogFile() = default;
+
+    LogFile(LogFile &&other) noexcept: fd(exchange(other.fd, -1)) {}
+
+    LogFile &operator=(LogFile &&other) noexcept {
+        if (this != &other) {
+            close();
+            fd = exchange(other.fd, -1);
+        }
+        return *this;
+    }
+
+    ~LogFile() { close(); }
+
+    bool open(const string &path) {
+#ifdef _WIN32
+        fd = _open(path.c_str(), _O_RDWR | _O_CREAT | _O_APPEND | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+#endif
+        return fd >= 0;
+    }
+
+    bool write(string_view data) {
+        while (!data.empty()) {
+#ifdef _WIN32
+            int written = _write(fd, data.data(), static_cast<unsigned>(min<size_t>(data.size(), 1 << 30)));
+#else
+            ssize_t written = ::write(fd, data.data(), data.size());
+#endif
+            if (written <= 0) return false;
+            data.remove_prefix(written);
+        }
+        return true;
+    }
+
+    bool sync() { return syncFile(fd); }
+
+    bool truncate(uint64_t size) {
+#ifdef _WIN32
+        return _chsize_s(fd, static_cast<long long>(size)) == 0;
+#else
+        return ftruncate(fd, static_cast<off_t>(size)) == 0;
+#endif
+    }
+
+    void close() {
+        if (fd < 0) return;
+#ifdef _WIN32
+        _close(fd);
+#else
+        ::close(fd);
+#endif
+        fd = -1;
+    }
+
+private:
+    int fd = -1;
+};
+
+/* Records are appended to a pending buffer under `pendingMutex` and written by `flush`, which holds `ioMutex` for
+ * the whole write so batches reach the file in the order they were appended. The statement thread only waits for
+ * the disk in `always` mode.
+ */
+class WriteAheadLog {
+public:
+    ~WriteAheadLog() { close(); }
+
+    // Continues the log at `path` after its first `validSize` bytes, or starts it over for `epoch` if that is 0
+    // (see replayWriteAheadLog)
+    bool open(const string &path, uint64_t epoch, uint64_t validSize) {
+        if (!file.open(path)) return false;
+        currentEpoch = epoch;
+        if (validSize == 0 ? !startEpoch(epoch) : !file.truncate(validSize)) return false;
+        flusher = thread([this] { flushPeriodically(); });
+        return true;
+    }
+
+    void append(WalRecordKind kind, string_view payload) {
+        WalRecordHeader header{static_cast<uint32_t>(payload.size()), kind, checksum64(payload.data(), payload.size())};
+        bool syncNow;
+        {
+            lock_guard<mutex> lock(pendingMutex);
+            pending.append(reinterpret_cast<const char *>(&header), sizeof(header));
+            pending.append(payload);
+            logged += sizeof(header) + payload.size();
+            syncNow = mode == SyncMode::Always || pending.size() > walPendingMaxBytes;
+        }
+        if (syncNow) flush(false);
+    }
+
+    void setSync(SyncMode newMode, chrono::milliseconds newInterval) {
+        flush(false);
+        lock_guard<mutex> lock(pendingMutex);
+        mode = newMode;
+        interval = newInterval;
+        wake.notify_one();
+    }
+
+    // Writes everything appended so far; syncs it unless the mode is `off` and `forceSync` is not set
+    void flush(bool forceSync) {
+        lock_guard<mutex> io(ioMutex);
+        bool sync;
+        {
+            lock_guard<mutex> lock(pendingMutex);
+            writing.clear();
+            swap(writing, pending);
+            sync = forceSync || mode != SyncMode::Off;
+        }
+        if (writing.empty() && !forceSync) return;
+        if (!file.write(writing) || (sync && !file.sync())) {
+            fmt::println("Could not write the write-ahead log");
+        }
+    }
+
+    // Completes the current log and continues in a new one at `path` for `epoch`
+    bool rotate(const string &path, uint64_t epoch) {
+        flush(true);
+        LogFile next;
+        if (!next.open(path)) return false;
+        lock_guard<mutex> io(ioMutex);
+        swap(file, next);
+        if (!startEpoch(epoch)) {
+            swap(file, next);
+            return false;
+        }
+        lock_guard<mutex> lock(pendingMutex);
+        currentEpoch = epoch;
+        logged = 0;
+        return true;
+    }
+
+    void close() {
+        {
+            lock_guard<mutex> lock(pendingMutex);
+            if (!flusher.joinable()) return;
+            stopping = true;
+            wake.notify_one();
+        }
+        flusher.join();
+        flush(true);
+        file.close();
+    }
+
+    uint64_t epoch() const { return currentEpoch; }
+
+    // Bytes appended since the log was opened or rotated
+    size_t loggedBytes() {
+        lock_guard<mutex> lock(pendingMutex);
+        return logged;
+    }
+
+private:
+    LogFile file;
+    uint64_t currentEpoch = 0;
+
+    mutex ioMutex;
+    string writing;  // the batch being written, guarded by ioMutex
+
+    mutex pendingMutex;
+    condition_variable wake;
+    string pending;
+    size_t logged = 0;
+    SyncMode mode = SyncMode::Group;
+    chrono::milliseconds interval = walDefaultGroupInterval;
+    bool stopping = false;
+
+    thread flusher;
+
+    bool startEpoch(uint64_t epoch) {
+        WalHeader header;
+        header.epoch = epoch;
+        return file.truncate(0) && file.write({reinterpret_cast<const char *>(&header), sizeof(header)}) &&
+               file.sync();
+    }
+
+    void flushPeriodically() {
+        unique_lock<mutex> lock(pendingMutex);
+        while (!stopping) {
+            wake.wait_for(lock, interval);
+            if (pending.empty() || mode == SyncMode::Always) continue;
+            lock.unlock();
+            flush(false);
+            lock.lock();
+        }
+    }
+};
+
+
+// Called by commitAppendedRows: logs the appended rows as column images, one bounded piece at a time
+void logAppendedRows(const string &tableName, const RowColumn<int> &table, size_t firstRow, size_t rows,
+                     Tables<int> &tables) {
+    if (!tables.wal) return;
+
+    string payload;
+    size_t end = firstRow + rows;
+    while (firstRow < end) {
+        // A piece of very long strings is built again with fewer rows
+        size_t pieceRows = min(walRecordRows, end - firstRow);
+        while (true) {
+            payload.clear();
+            putString(payload, tableName);
+            putU64(payload, pieceRows);
+            putU32(payload, static_cast<uint32_t>(table.columns.size()));
+            for (const Column &column: table.columns) {
+                putU32(payload, static_cast<uint32_t>(column.type));
+                size_t sizePosition = payload.size();
+                putU64(payload, 0);
+                appendColumnCells(payload, column, firstRow, pieceRows);
+                uint64_t size = payload.size() - sizePosition - sizeof(uint64_t);
+                memcpy(payload.data() + sizePosition, &size, sizeof(size));
+            }
+            if (payload.size() <= walRecordMaxBytes || pieceRows == 1) break;
+            pieceRows /= 2;
+        }
+        firstRow += pieceRows;
+        tables.wal->append(firstRow < end ? WalRecordKind::RowsPart : WalRecordKind::Rows, payload);
+    }
+}
+
+void logStatement(Tokens query, Tables<int> &tables) {
+    string payload;
+    putU32(payload, static_cast<uint32_t>(query.size()));
+    for (string_view token: query) putString(payload, token);
+    tables.wal->append(WalRecordKind::Statement, payload);
+}
+
+void executeStatement(Tokens query, Tables<int> &tables);
+
+// Appends the rows of a Rows or RowsPart record to the columns of their table, without committing them
+bool replayRows(string_view payload, Tables<int> &tables, string &tableName, uint64_t &rows) {
+    SnapshotReader reader(payload);
+    tableName = reader.str();
+    rows = reader.u64();
+    uint32_t columnCount = reader.u32();
+    auto table = tables.tables.find(tableName);
+    if (!reader.ok() || table == tables.tables.end() || columnCount != table->second.columns.size()) return false;
+
+    vector<Column> appended;
+    vector<uint64_t> aligned;  // cells are not aligned inside the record
+    for (uint32_t c = 0; c < columnCount; ++c) {
+        auto type = static_cast<ColumnType>(reader.u32());
+        string_view cells = reader.bytes(reader.u64());
+        if (!reader.ok() || type != table->second.columns[c].type) return false;
+        aligned.assign((cells.size() + sizeof(uint64_t) - 1) / sizeof(uint64_t), 0);
+        memcpy(aligned.data(), cells.data(), cells.size());
+        Column &column = appended.emplace_back(type);
+        if (!loadColumnBlock({reinterpret_cast<const char *>(aligned.data()), cells.size()}, rows, column, nullptr)) {
+            return false;
+        }
+    }
+
+    for (uint32_t c = 0; c < columnCount; ++c) table->second.columns[c].appendColumn(std::move(appended[c]));
+    return true;
+}
+
+void replayStatement(string_view payload, Tables<int> &tables) {
+    SnapshotReader reader(payload);
+    vector<string> tokens(reader.u32());
+    for (auto &token: tokens) token = reader.str();
+    vector<string_view> query(tokens.begin(), tokens.end());
+    if (reader.ok() && !query.empty()) executeStatement(query, tables);
+}
+
+/* Applies the log of `epoch` at `path`. Returns the size of the intact part of the file that the log continues
+ * after, or 0 if it has to be started over.
+ */
+uint64_t replayWriteAheadLog(const string &path, uint64_t epoch, Tables<int> &tables) {
+    MappedFile file(path);
+    string_view text = file.view();
+    WalHeader header;
+    if (!file.isOpen() || text.size() < sizeof(header)) return 0;
+    memcpy(&header, text.data(), sizeof(header));
+    if (header.magic != walMagic || header.version != walVersion || header.byteOrder != snapshotByteOrder ||
+        header.epoch != epoch) {
+        fmt::println("'{}' is not a write-ahead log of epoch {} of this program version; starting a new one", path,
+                     epoch);
+        return 0;
+    }
+
+    auto start = chrono::steady_clock::now();
+    size_t pos = sizeof(header);
+    size_t records = 0;
+
+    // The batch whose RowsPart records were appended but not yet committed
+    string batchTable;
+    uint64_t batchRows = 0;
+    size_t batchStart = 0;
+    size_t batchRecords = 0;
+
+    while (text.size() - pos >= sizeof(WalRecordHeader)) {
+        WalRecordHeader record;
+        memcpy(&record, text.data() + pos, sizeof(record));
+        if (record.size > text.size() - pos - sizeof(record)) break;
+        string_view payload = text.substr(pos + sizeof(record), record.size);
+        if (checksum64(payload.data(), payload.size()) != record.checksum) break;
+
+        // Only a short or damaged record is a torn tail; an intact one that cannot be applied means the log does not
+        // belong to this state, and cutting it would lose every record after it
+        bool applied = false;
+        if (record.kind == WalRecordKind::Rows || record.kind == WalRecordKind::RowsPart) {
+            string tableName;
+            uint64_t rows = 0;
+            applied = replayRows(payload, tables, tableName, rows) && (batchRows == 0 || tableName == batchTable);
+            if (applied && batchRows == 0) {
+                batchTable = tableName;
+                batchStart = pos;
+                batchRecords = records;
+            }
+            batchRows += rows;
+            if (applied && record.kind == WalRecordKind::Rows) {
+                applied = commitAppendedRows(batchTable, batchRows, tables);
+                batchRows = 0;
+            }
+        } else if (record.kind == WalRecordKind::Statement && batchRows == 0) {
+            replayStatement(payload, tables);
+            applied = true;
+        }
+        if (!applied) {
+            fmt::println("Write-ahead log '{}': the record at offset {} could not be applied; the log is left unchanged",
+                         path, pos);
+            exit(1);
+        }
+        pos += sizeof(record) + record.size;
+        ++records;
+    }
+
+    // The log ends inside a batch: its rows were never committed
+    if (batchRows > 0) {
+        RowColumn<int> &table = tables.tables[batchTable];
+        truncateColumns(table, table.numRows);
+        pos = batchStart;
+        records = batchRecords;
+    }
+    if (pos < text.size()) {
+        fmt::println("Write-ahead log '{}': discarded {} bytes of incomplete or damaged records", path,
+                     text.size() - pos);
+    }
+    if (records > 0) {
+        double seconds = max(chrono::duration<double>(chrono::steady_clock::now() - start).count(), 1e-9);
+        fmt::println("Replayed {} write-ahead log records ({:.1f} MB in {:.2f}s)", records, pos / 1e6, seconds);
+    }
+    return pos;
+}
+
+/* Restores the database of `directory`, creating the directory if needed, and attaches its log. */
+void openDataDirectory(const string &directory, Tables<int> &tables) {
+    error_code error;
+    filesystem::create_directories(directory, error);
+    filesystem::path root(directory);
+
+    uint64_t epoch = 0;
+    bool hasSnapshot = false;
+    optional<uint64_t> firstLog;
+    for (const auto &entry: filesystem::directory_iterator(root, error)) {
+        string name = entry.path().filename().string();
+        uint64_t fileEpoch;
+        if (parseEpochFileName(name, "snapshot-", ".snap", fileEpoch) && (!hasSnapshot || fileEpoch > epoch)) {
+            epoch = fileEpoch;
+            hasSnapshot = true;
+        }
+        if (parseEpochFileName(name, "wal-", ".log", fileEpoch) && (!firstLog || fileEpoch < *firstLog)) {
+            firstLog = fileEpoch;
+        }
+    }
+    // Without a snapshot the logs have to start at epoch 0, where an interrupted first checkpoint leaves them
+    if (!hasSnapshot && firstLog && *firstLog > 0) {
+        fmt::println("Data directory '{}' is missing '{}'", directory, snapshotFileName(*firstLog));
+        exit(1);
+    }
+    if (hasSnapshot) {
+        SnapshotOrigin origin;
+        if (!processLoadSnapshot((root / snapshotFileName(epoch)).string(), false, tables, &origin)) exit(1);
+        tables.snapshotTables = std::move(origin.tables);
+    }
+
+    // A checkpoint that did not finish leaves the logs of several epochs
+    uint64_t validSize = replayWriteAheadLog((root / walFileName(epoch)).string(), epoch, tables);
+    while (filesystem::exists(root / walFileName(epoch + 1))) {
+        ++epoch;
+        validSize = replayWriteAheadLog((root / walFileName(epoch)).string(), epoch, tables);
+    }
+
+    string walPath = (root / walFileName(epoch)).string();
+    auto wal = make_shared<WriteAheadLog>();
+    if (!wal->open(walPath, epoch, validSize)) {
+        fmt::println("Could not open write-ahead log '{}'", walPath);
+        exit(1);
+    }
+    tables.dataDirectory = directory;
+    tables.wal = std::move(wal);
+    fmt::println("Data directory '{}': {} tables, logging changes to '{}'", directory, tables.tables.size(), walPath);
+}
+
+// A checkpoint written by a background thread, from shared copies of the tables that changed
+class CheckpointJob {
+public:
+    Tables<int> changed;    // the changed tables with their primary keys and indexes, and all foreign keys
+    SnapshotTables stored;  // the unchanged tables; once written, every table of the snapshot
+    string directory;
+    uint64_t epoch = 0;
+    bool succeeded = false;
+    atomic<bool> done = false;
+    thread worker;
+};
+
+void writeCheckpoint(CheckpointJob &job) {
+    filesystem::path root(job.directory);
+    job.succeeded = processSaveSnapshot((root / snapshotFileName(job.epoch)).string(), job.changed, job.epoch,
+                                        &job.stored) && syncDirectory(job.directory);
+
+    // Older logs are contained in the snapshot now, older snapshot files only matter for the tables still read there
+    vector<filesystem::path> obsolete;
+    error_code error;
+    for (const auto &entry: filesystem::directory_iterator(root, error)) {
+        if (!job.succeeded) break;
+        string name = entry.path().filename().string();
+        uint64_t fileEpoch;
+        bool referenced = any_of(job.stored.begin(), job.stored.end(),
+                                 [&name](const auto &table) { return table.second.file == name; });
+        if ((parseEpochFileName(name, "wal-", ".log", fileEpoch) && fileEpoch < job.epoch) ||
+            (parseEpochFileName(name, "snapshot-", ".snap", fileEpoch) && fileEpoch < job.epoch && !referenced)) {
+            obsolete.push_back(entry.path());
+        }
+    }
+    for (const auto &path: obsolete) filesystem::remove(path, error);
+    job.done = true;
+}
+
+/* Takes over the result of the background checkpoint once it is done, or waits for it if `wait` is set: the tables
+ * written by it are located in the new snapshot unless they changed again in the meantime.
+ */
+void finishCheckpoint(Tables<int> &tables, bool wait) {
+    shared_ptr<CheckpointJob> job = tables.checkpoint;
+    if (!job || (!wait && !job->done)) return;
+    if (job->worker.joinable()) job->worker.join();
+    tables.checkpoint = nullptr;
+
+    string file = snapshotFileName(job->epoch);
+    for (auto location = tables.snapshotTables.begin(); location != tables.snapshotTables.end();) {
+        auto written = job->stored.find(location->first);
+        if (location->second.file != file || !location->second.entry.empty()) {
+            ++location;
+        } else if (job->succeeded && written != job->stored.end()) {
+            location->second = written->second;
+            ++location;
+        } else {
+            location = tables.snapshotTables.erase(location);
+        }
+    }
+}
+
+/* checkpoint: starts writing the changes since the last checkpoint to a new snapshot, see the section comment.
+ *
+ * The log cannot describe a database `replaced` by `load` or `open`, so its snapshot is written on this thread before
+ * the log moves on to the new epoch: a crash in between restarts from the previous snapshot and logs. If it cannot be
+ * written, logging stops.
+ */
+void processCheckpoint(Tables<int> &tables, bool replaced) {
+    if (!tables.wal) {
+        fmt::println("checkpoint needs a data directory; start the program with one");
+        return;
+    }
+    finishCheckpoint(tables, true);
+
+    auto job = make_shared<CheckpointJob>();
+    job->directory = tables.dataDirectory;
+    job->epoch = tables.wal->epoch() + 1;
+    string walPath = (filesystem::path(job->directory) / walFileName(job->epoch)).string();
+    if (!replaced && !tables.wal->rotate(walPath, job->epoch)) {
+        fmt::println("Could not start the write-ahead log of epoch {}", job->epoch);
+        return;
+    }
+
+    // From here on the log describes changes to the snapshot being written
+    for (auto &[tableName, table]: tables.tables) {
+        auto location = tables.snapshotTables.find(tableName);
+        if (location != tables.snapshotTables.end()) {
+            job->stored.insert(*location);
+            continue;
+        }
+        job->changed.tables[tableName] = table.share();
+        if (tables.primaryKeys.contains(tableName)) job->changed.primaryKeys[tableName] = tables.primaryKeys[tableName];
+        job->changed.primaryKeyIndexes[tableName] = tables.primaryKeyIndexes[tableName].share();
+        tables.snapshotTables[tableName] = {snapshotFileName(job->epoch), ""};  // filled in by finishCheckpoint
+    }
+    job->changed.foreignKeys = tables.foreignKeys;
+
+    tables.checkpoint = job;
+    if (!replaced) {
+        fmt::println("Checkpoint of epoch {} started: {} changed tables, {} unchanged", job->epoch,
+                     job->changed.tables.size(), job->stored.size());
+        job->worker = thread([job = job.get()] { writeCheckpoint(*job); });
+        return;
+    }
+
+    writeCheckpoint(*job);
+    finishCheckpoint(tables, true);
+    if (!job->succeeded || !tables.wal->rotate(walPath, job->epoch)) {
+        fmt::println("Could not checkpoint the new database to '{}'; changes are no longer logged", job->directory);
+        tables.wal->close();
+        tables.wal = nullptr;
+        return;
+    }
+    fmt::println("Checkpoint of epoch {} written: {} tables", job->epoch, job->changed.tables.size());
+}
+
+// set sync always | group [milliseconds] | off
+void processSetSync(Tokens query, Tables<int> &tables) {
+    SyncMode mode;
+    int milliseconds = walDefaultGroupInterval.count();
+    bool valid = query.size() == 3 || (query.size() == 4 && query[2] == "group");
+    if (valid && query.size() == 4) {
+        auto [end, error] = from_chars(query[3].data(), query[3].data() + query[3].size(), milliseconds);
+        valid = error == errc() && end == query[3].data() + query[3].size() && milliseconds > 0;
+    }
+    if (valid && query[2] == "always") {
+        mode = SyncMode::Always;
+    } else if (valid && query[2] == "group") {
+        mode = SyncMode::Group;
+    } else if (valid && query[2] == "off") {
+        mode = SyncMode::Off;
+    } else {
+        fmt::println("usage: set sync <always|group [milliseconds]|off>");
+        return;
+    }
+
+    if (!tables.wal) {
+        fmt::println("sync mode needs a data directory; start the program with one");
+        return;
+    }
+    tables.wal->setSync(mode, chrono::milliseconds(milliseconds));
+    fmt::println("sync mode set to {}", query[2]);
+}
+
+
+constexpr size_t loadChunkSize = 4 << 20;
+
+/* Streams a SQL script through the tokenizer:
+ *
+ *     load path
+ *
+ * The file is read in `loadChunkSize` pieces. Only text up to the last separator of the buffer is tokenized, and a
+ * statement runs once the next one has started (or the file has ended), so the buffer holds at most the statement
+ * being read plus one chunk. The tokens of that statement are kept along with the text, so every byte is tokenized
+ * and split once. Progress is printed about once a second, throughput when the load finishes.
+ */
+void processFile(Tokens query, Tables<int> &tables) {
+    if (query.size() < 2) {
+        fmt::println("usage: load <path>");
+        return;
+    }
+    string path(tokenText(query[1]));
+
+    if (!filesystem::exists(path)) {
+        fmt::println("no such file exists");
+        return;
+    }
+
+    if (isSnapshotFile(path)) {
+        processLoadSnapshot(path, false, tables);
+        return;
+    }
+
+    ifstream file(path, ios::binary);
+    if (!file.is_open()) {
+        fmt::println("Could not open file '{}'", path);
+        return;
+    }
+    double fileMegabytes = filesystem::file_size(path) / 1e6;
+
+    string buffer;
+    vector<string_view> tokens;  // of buffer[0, tokenized), from the first token of the statement being read
+    size_t tokenized = 0;
+    StatementSplit split;
+    size_t bytesRead = 0;
+    size_t statementsRun = 0;
+    auto start = chrono::steady_clock::now();
+    auto lastReport = start;
+
+    // Points the tokens into `to` where their text has moved from `from`
+    auto moveTokens = [&tokens](const char *from, const char *to) {
+        for (string_view &token: tokens) token = string_view(to + (token.data() - from), token.size());
+    };
+    auto run = [&](Tokens statement) {
+        executeStatement(statement, tables);
+        ++statementsRun;
+    };
+
+    bool atEnd = false;
+    while (!atEnd) {
+        size_t keptBytes = buffer.size();
+        if (buffer.capacity() < keptBytes + loadChunkSize) {
+            string grown;
+            grown.reserve(max(2 * buffer.capacity(), keptBytes + loadChunkSize));
+            grown = buffer;
+            moveTokens(buffer.data(), grown.data());
+            buffer.swap(grown);
+        }
+        buffer.resize(keptBytes + loadChunkSize);
+        file.read(buffer.data() + keptBytes, loadChunkSize);
+        buffer.resize(keptBytes + file.gcount());
+        bytesRead += file.gcount();
+        atEnd = !file;
+
+        // Text before `tokenized` ends on a separator, so the scan for the next one can start there
+        size_t complete = atEnd ? buffer.size() : tokenized + completeTokensEnd(string_view(buffer).substr(tokenized));
+        tokenize(buffer.data() + tokenized, complete - tokenized, tokens);
+        tokenized = complete;
+
+        // The last token may still decide whether a statement starts (`alter table`), so it waits for the next chunk
+        splitStatements(tokens, atEnd || tokens.empty() ? tokens.size() : tokens.size() - 1, split, run);
+        if (atEnd) {
+            if (split.begin < tokens.size()) run(Tokens(tokens).subspan(split.begin));
+            break;
+        }
+
+        // Drop the text and tokens of the statements that ran; the last statement may continue in the next chunk
+        size_t consumed = split.begin < tokens.size() ? tokens[split.begin].data() - buffer.data() : complete;
+        buffer.erase(0, consumed);
+        moveTokens(buffer.data() + consumed, buffer.data());
+        tokens.erase(tokens.begin(), tokens.begin() + split.begin);
+        split.next -= split.begin;
+        split.begin = 0;
+        tokenized -= consumed;
+
+        auto now = chrono::steady_clock::now();
+        if (!atEnd && now - lastReport >= chrono::seconds(1)) {
+            double seconds = chrono::duration<double>(now - start).count();
+            fmt::println("load: {:.1f}/{:.1f} MB, {} statements, {:.0f} statements/s, {:.1f} MB/s", bytesRead / 1e6,
+                         fileMegabytes, statementsRun, statementsRun / seconds, bytesRead / 1e6 / seconds);
+            lastReport = now;
+        }
+    }
+
+    double seconds = max(chrono::duration<double>(chrono::steady_clock::now() - start).count(), 1e-9);
+    fmt::println("loaded '{}': {} statements, {:.1f} MB in {:.2f}s ({:.0f} statements/s, {:.1f} MB/s)", path,
+                 statementsRun, bytesRead / 1e6, seconds, statementsRun / seconds, bytesRead / 1e6 / seconds);
+}
+
+
+/* -- Text save:
+ *
+ *     save path
+ *
+ * The file is cut into tasks in file order: the title and header of a table, then its rows in pieces of
+ * `saveChunkRows`. Worker threads take the tasks in order and format each into a buffer of its own, while the calling
+ * thread writes the finished buffers in order, one large write per buffer. Workers stay at most `saveWindow` tasks
+ * ahead of the writer, so memory is bounded when the disk is slower than formatting.
+ */
+constexpr size_t saveChunkRows = 64 * 1024;
+constexpr size_t saveWindow = 64;
+
+struct SaveTask {
+    const string *tableName;
+    const RowColumn<int> *table;
+    size_t firstRow;
+    size_t endRow;
+    bool header;
+    bool last;  // ends the table with a blank line
+};
 
-        if (inReferencedColumns && query[i] == "(") continue;
-        if (inReferencedColumns && query[i] == ")") {
-            inReferencedColumns = false;
-            continue;
+void formatSaveTask(const SaveTask &task, fmt::memory_buffer &buffer) {
+    auto out = back_inserter(buffer);
+    const auto &columns = task.table->columns;
+    if (task.header) {
+        fmt::format_to(out, "Table: {}\n", *task.tableName);
+        for (const auto &columnSchema: task.table->schema.columns) {
+            fmt::format_to(out, "| {:15} ", columnSchema.name);
         }
-        if (inReferencedColumns) {
-            referencedColumns.push_back(query[i]);
+        fmt::format_to(out, "|\n");
+        for (size_t i = 0; i < columns.size(); ++i) {
+            fmt::format_to(out, "|{:-^17}", "");
         }
+        fmt::format_to(out, "|\n");
     }
 
-    // Check that types of referencing and referenced columns match
-    for (size_t i = 0; i < referencingColumns.size(); ++i) {
-        const auto &referencingCol = tables.tables[tableName].rowColumn[referencingColumns[i]];
-        const auto &referencedCol = tables.tables[referencedTable].rowColumn[referencedColumns[i]];
-
-        if (!referencingCol.empty() && !referencedCol.empty()) {
-            if (referencingCol.front().index() != referencedCol.front().index()) {
-                fmt::println(
-                        "Type mismatch: referencing column '{}' and referenced column '{}' must be of the same type.",
-                        referencingColumns[i], referencedColumns[i]);
-                return;
+    for (size_t rowIdx = task.firstRow; rowIdx < task.endRow; ++rowIdx) {
+        for (const auto &column: columns) {
+            switch (column.type) {
+                case ColumnType::Int:
+                    fmt::format_to(out, "| {:<15} ", column.ints[rowIdx]);
+                    break;
+                case ColumnType::Float:
+                    fmt::format_to(out, "| {:<15} ", column.floats[rowIdx]);
+                    break;
+                case ColumnType::String:
+                    fmt::format_to(out, "| {:15} ", column.strings[rowIdx]);
+                    break;
             }
         }
+        fmt::format_to(out, "|\n");
     }
+    if (task.last) fmt::format_to(out, "\n");
+}
 
-
-    for (const auto &fk: tables.foreignKeys) {
-        if (fk.referencingTable == tableName &&
-            fk.referencedTable == referencedTable &&
-            fk.referencingColumns == referencingColumns &&
-            fk.referencedColumns == referencedColumns) {
-            fmt::println("This foreign key relationship already exists.");
-            return;
-        }
+void processSave(const string &filePath, Tables<int> &tables) {
+    if (filePath.ends_with(".snap")) {
+        processSaveSnapshot(filePath, tables);
+        tables.savingPath = filePath;
+        return;
     }
 
-    //  Check existence of referenced table
-    if (!tables.tables.contains(referencedTable)) {
-        fmt::println("Table '{}' does not exist.", referencedTable);
+    LogFile out;
+    if (!out.open(filePath) || !out.truncate(0)) {  // overwrite the file
+        fmt::println("Could not open file '{}'", filePath);
         return;
     }
+    tables.savingPath = filePath;
 
-    //  Check if referenced columns exist in referenced table
-    for (const auto &col: referencedColumns) {
-        if (!tables.tables[referencedTable].rowColumn.contains(col)) {
-            fmt::println("Referenced column '{}' does not exist in table '{}'.", col, referencedTable);
-            return;
-        }
+    vector<SaveTask> tasks;
+    for (const auto &[tableName, table]: tables.tables) {
+        if (table.columns.empty()) continue;
+        size_t firstRow = 0;
+        do {
+            size_t endRow = min(firstRow + saveChunkRows, table.numRows);
+            tasks.push_back({&tableName, &table, firstRow, endRow, firstRow == 0, endRow == table.numRows});
+            firstRow = endRow;
+        } while (firstRow < table.numRows);
     }
 
-    //  Check if referencing columns exist in referencing table
-    for (const auto &col: referencingColumns) {
-        if (!tables.tables[tableName].rowColumn.contains(col)) {
-            fmt::println("Referencing column '{}' does not exist in table '{}'.", col, tableName);
-            return;
-        }
+    vector<fmt::memory_buffer> buffers(tasks.size());
+    vector<char> formatted(tasks.size(), false);
+    size_t nextTask = 0;
+    size_t written = 0;
+    mutex progress;
+    condition_variable changed;
+
+    vector<thread> workers;
+    size_t numWorkers = clamp<size_t>(tasks.size(), 1, max(1u, thread::hardware_concurrency()));
+    for (size_t w = 0; w < numWorkers; ++w) {
+        workers.emplace_back([&] {
+            unique_lock<mutex> lock(progress);
+            while (true) {
+                changed.wait(lock, [&] { return nextTask == tasks.size() || nextTask < written + saveWindow; });
+                if (nextTask == tasks.size()) return;
+                size_t task = nextTask++;
+                lock.unlock();
+                formatSaveTask(tasks[task], buffers[task]);
+                lock.lock();
+                formatted[task] = true;
+                changed.notify_all();
+            }
+        });
     }
 
-    // : Check if referenced columns match the primary key of the referenced table
-    auto pkOfReferenced = tables.primaryKeys[referencedTable];
-    vector<string> sortedReferenced = referencedColumns;
-    vector<string> sortedPK = pkOfReferenced;
-
-    sort(sortedReferenced.begin(), sortedReferenced.end());
-    sort(sortedPK.begin(), sortedPK.end());
-
-    if (sortedReferenced != sortedPK) {
-        fmt::println("Referenced columns do not match the primary key of '{}'.", referencedTable);
-        return;
+    bool failed = false;
+    for (size_t task = 0; task < tasks.size(); ++task) {
+        {
+            unique_lock<mutex> lock(progress);
+            changed.wait(lock, [&] { return formatted[task]; });
+        }
+        const auto &buffer = buffers[task];
+        failed = failed || !out.write({buffer.data(), buffer.size()});
+        buffers[task] = fmt::memory_buffer();  // release it
+        lock_guard<mutex> lock(progress);
+        written = task + 1;
+        changed.notify_all();
     }
+    for (auto &worker: workers) worker.join();
 
-    // Step 5: Ensure sizes match (number of columns)
-    if (referencingColumns.size() != referencedColumns.size()) {
-        fmt::println("Mismatched column count in referencing and referenced keys.");
+    if (failed) {
+        fmt::println("Could not write file '{}'", filePath);
         return;
     }
-
-    // Step 6: Save the foreign key definition
-    ForeignKey foreignKey = ForeignKey(tableName, referencingColumns, referencedTable, referencedColumns);
-    tables.foreignKeys.push_back(foreignKey);
-
+    fmt::println("All tables saved to '{}'", filePath);
 }
 
-auto defineNumberOfAlterStatements(const vector<string> &query) {
-    vector<vector<string>> result;
-    vector<string>::const_iterator beginRange;
-    vector<string>::const_iterator endRange;
 
-    bool isAlterStatement = false;
+/* -- Bulk loading:
+ *
+ *     copy table from path [csv | tsv]
+ *
+ * The first line of the file names the columns, in any order; every column of the table has to be present. CSV
+ * fields may be quoted with `"` (quotes inside are doubled), TSV fields are taken as they are.
+ *
+ * The file is mapped and cut into one chunk per thread on record boundaries. Each thread parses its chunk straight
+ * into typed columns of its own, which are then moved behind the table's columns in file order, and the constraints
+ * of all new rows are checked in one pass by `commitAppendedRows`. Any error leaves the table unchanged.
+ */
+
+constexpr size_t copyMinChunkSize = 1 << 20;
 
-    for (auto it = query.begin(); it != query.end(); ++it) {
-        if (*it == "alter" && (it + 1 != query.end()) && *(it + 1) == "table") {
-            beginRange = it;
-            isAlterStatement = true;
-        }
+struct CopyFormat {
+    char separator = ',';
+    bool quoted = true;
+};
 
-        if (isAlterStatement && (*it == "drop" || *it == "add" || *it == "foreign")) {
+/* Splits the record starting at `pos` into `fields` and returns the position after its line break. Fields are views
+ * into `text`; a quoted field with doubled quotes is unescaped into the matching `scratch` string instead.
+ */
+size_t parseRecord(string_view text, size_t pos, CopyFormat format, vector<string_view> &fields,
+                   vector<string> &scratch) {
+    fields.clear();
+    while (true) {
+        if (format.quoted && pos < text.size() && text[pos] == '"') {
+            size_t start = ++pos;
+            bool hasEscapes = false;
+            size_t end = text.size();
+            while (pos < text.size()) {
+                size_t quote = text.find('"', pos);
+                if (quote == string_view::npos) {
+                    pos = text.size();
+                    break;
+                }
+                if (quote + 1 < text.size() && text[quote + 1] == '"') {
+                    hasEscapes = true;
+                    pos = quote + 2;
+                    continue;
+                }
+                end = quote;
+                pos = quote + 1;
+                break;
+            }
 
-            auto tempIt = it;
-            while (tempIt != query.end() && *tempIt != "alter") {
-                ++tempIt;
+            string_view field = text.substr(start, end - start);
+            if (hasEscapes) {
+                if (scratch.size() <= fields.size()) scratch.resize(fields.size() + 1);
+                string &unescaped = scratch[fields.size()];
+                unescaped.clear();
+                for (size_t i = 0; i < field.size(); ++i) {
+                    unescaped.push_back(field[i]);
+                    if (field[i] == '"') ++i;
+                }
+                field = unescaped;
             }
-            endRange = tempIt;
+            fields.push_back(field);
+        } else {
+            size_t end = pos;
+            while (end < text.size() && text[end] != format.separator && text[end] != '\n') ++end;
+            size_t fieldEnd = (end > pos && text[end - 1] == '\r') ? end - 1 : end;
+            fields.push_back(text.substr(pos, fieldEnd - pos));
+            pos = end;
+        }
 
-            result.emplace_back(beginRange, endRange);
-            it = --tempIt;
-            isAlterStatement = false;
+        if (pos < text.size() && text[pos] == format.separator) {
+            ++pos;
+            continue;
         }
+        if (pos < text.size() && text[pos] == '\r') ++pos;
+        if (pos < text.size() && text[pos] == '\n') ++pos;
+        return pos;
     }
+}
 
-    return result;
+// Start of the first record after `pos`, given whether `pos` lies inside a quoted field
+size_t nextRecordStart(string_view text, size_t pos, CopyFormat format, bool insideQuotes) {
+    for (; pos < text.size(); ++pos) {
+        if (format.quoted && text[pos] == '"') {
+            insideQuotes = !insideQuotes;
+        } else if (text[pos] == '\n' && !insideQuotes) {
+            return pos + 1;
+        }
+    }
+    return text.size();
 }
 
-void alterTableDropColumn(const vector<string> &query, Tables<int> &tables, const string &tableName) {
+// The rows one thread parsed from its chunk
+struct CopyChunk {
+    vector<Column> columns;
+    size_t rows = 0;
+    string error;  // set if the chunk stopped at an invalid record
+};
 
-    string columnToDrop = query[4];
+void parseCopyChunk(string_view text, CopyFormat format, const RowColumn<int> &table,
+                    const vector<size_t> &ordinalByField, CopyChunk &chunk) {
+    for (const auto &column: table.columns) {
+        chunk.columns.emplace_back(column.type);
+    }
 
+    vector<string_view> fields;
+    vector<string> scratch;
+    size_t pos = 0;
+    while (pos < text.size()) {
+        if (text[pos] == '\n' || (text[pos] == '\r' && pos + 1 < text.size() && text[pos + 1] == '\n')) {
+            pos = text.find('\n', pos) + 1;  // blank line
+            continue;
+        }
 
-    if (!tables.tables.contains(tableName)) {
-        fmt::println("Table '{}' does not exist.", tableName);
-        return;
+        pos = parseRecord(text, pos, format, fields, scratch);
+        if (fields.size() != ordinalByField.size()) {
+            chunk.error = fmt::format("expected {} fields, found {}", ordinalByField.size(), fields.size());
+            return;
+        }
+        for (size_t i = 0; i < fields.size(); ++i) {
+            size_t ordinal = ordinalByField[i];
+            if (!chunk.columns[ordinal].appendText(fields[i])) {
+                // Undo the fields of this record that were already appended
+                for (size_t j = 0; j < i; ++j) {
+                    Column &column = chunk.columns[ordinalByField[j]];
+                    column.resize(chunk.rows, defaultColumnValue(column.type));
+                }
+                chunk.error = fmt::format("invalid value '{}' for column '{}'", fields[i],
+                                          table.schema.columns[ordinal].name);
+                return;
+            }
+        }
+        ++chunk.rows;
     }
+}
 
-    RowColumn<int> &table = tables.tables[tableName];
-
+void processCopyFrom(const string &tableName, const string &path, CopyFormat format, Tables<int> &tables) {
+    auto start = chrono::steady_clock::now();
 
-    if (!table.rowColumn.contains(columnToDrop)) {
-        fmt::println("Column '{}' does not exist in table '{}'.", columnToDrop, tableName);
+    MappedFile file(path);
+    if (!file.isOpen()) {
+        fmt::println("Could not open file '{}'", path);
         return;
     }
+    string_view text = file.view();
+    if (text.empty()) {
+        fmt::println("'{}' is empty, expected a header line", path);
+        return;
+    }
+    RowColumn<int> &table = tables.tables[tableName];
 
+    // Header: map every field to the ordinal of its column
+    vector<string_view> fields;
+    vector<string> scratch;
+    size_t dataStart = parseRecord(text, 0, format, fields, scratch);
+    vector<size_t> ordinalByField;
+    vector<bool> present(table.schema.columns.size(), false);
+    for (string_view name: fields) {
+        const ColumnSchema *columnSchema = table.schema.find(name);
+        if (!columnSchema) {
+            fmt::println("No such column '{}' in table '{}'", name, tableName);
+            return;
+        }
+        if (present[columnSchema->ordinal]) {
+            fmt::println("Column '{}' appears twice in the header of '{}'", name, path);
+            return;
+        }
+        present[columnSchema->ordinal] = true;
+        ordinalByField.push_back(columnSchema->ordinal);
+    }
+    for (const auto &columnSchema: table.schema.columns) {
+        if (!present[columnSchema.ordinal]) {
+            fmt::println("Column '{}' missing from the header of '{}'", columnSchema.name, path);
+            return;
+        }
+    }
 
-    auto &pkCols = tables.primaryKeys[tableName];
-    if (find(pkCols.begin(), pkCols.end(), columnToDrop) != pkCols.end()) {
-        fmt::println("Cannot drop column '{}': it is part of the primary key.", columnToDrop);
-        return;
+    // Cut the data into equal parts, then move every cut to the next record boundary. Whether a cut lies inside a
+    // quoted field follows from the parity of the quotes before it, which the threads count in parallel.
+    string_view data = text.substr(dataStart);
+    size_t numChunks = clamp<size_t>(data.size() / copyMinChunkSize, 1, max(1u, thread::hardware_concurrency()));
+    size_t chunkSize = data.size() / numChunks;
+    vector<size_t> quoteCounts(numChunks, 0);
+    if (format.quoted && numChunks > 1) {
+        vector<thread> workers;
+        for (size_t i = 0; i < numChunks; ++i) {
+            workers.emplace_back([&, i] {
+                size_t end = i + 1 == numChunks ? data.size() : (i + 1) * chunkSize;
+                quoteCounts[i] = count(data.begin() + i * chunkSize, data.begin() + end, '"');
+            });
+        }
+        for (auto &worker: workers) worker.join();
     }
 
+    vector<size_t> boundaries{0};
+    size_t quotesBefore = 0;
+    for (size_t i = 1; i < numChunks; ++i) {
+        quotesBefore += quoteCounts[i - 1];
+        size_t cut = i * chunkSize;
+        if (boundaries.back() >= cut) {
+            boundaries.push_back(boundaries.back());  // the previous record ran past this cut
+            continue;
+        }
+        // Scan from the character before the cut, so a cut right after a line break is kept
+        size_t quotesBeforeScan = quotesBefore - (data[cut - 1] == '"' ? 1 : 0);
+        boundaries.push_back(nextRecordStart(data, cut - 1, format, quotesBeforeScan % 2 == 1));
+    }
+    boundaries.push_back(data.size());
+
+    vector<CopyChunk> chunks(numChunks);
+    {
+        vector<thread> workers;
+        for (size_t i = 0; i < numChunks; ++i) {
+            workers.emplace_back([&, i] {
+                string_view part = data.substr(boundaries[i], boundaries[i + 1] - boundaries[i]);
+                parseCopyChunk(part, format, table, ordinalByField, chunks[i]);
+            });
+        }
+        for (auto &worker: workers) worker.join();
+    }
 
-    for (const auto &fk: tables.foreignKeys) {
-        if ((fk.referencingTable == tableName &&
-             find(fk.referencingColumns.begin(), fk.referencingColumns.end(), columnToDrop) !=
-             fk.referencingColumns.end()) ||
-            (fk.referencedTable == tableName &&
-             find(fk.referencedColumns.begin(), fk.referencedColumns.end(), columnToDrop) !=
-             fk.referencedColumns.end())) {
-            fmt::println("Cannot drop column '{}': it is part of a foreign key relationship.", columnToDrop);
+    size_t newRows = 0;
+    for (const auto &chunk: chunks) {
+        if (!chunk.error.empty()) {
+            fmt::println("copy failed at record {} of '{}': {}", newRows + chunk.rows + 1, path, chunk.error);
             return;
         }
+        newRows += chunk.rows;
     }
 
+    const size_t firstNewRow = table.numRows;
+    for (size_t ordinal = 0; ordinal < table.columns.size(); ++ordinal) {
+        Column &column = table.columns[ordinal];
+        column.reserve(firstNewRow + newRows);
+        for (auto &chunk: chunks) {
+            column.appendColumn(std::move(chunk.columns[ordinal]));
+        }
+    }
 
-    table.rowColumn.erase(columnToDrop);
-    fmt::println("Column '{}' dropped from table '{}'.", columnToDrop, tableName);
+    if (!commitAppendedRows(tableName, newRows, tables)) {
+        return;
+    }
+
+    double seconds = max(chrono::duration<double>(chrono::steady_clock::now() - start).count(), 1e-9);
+    fmt::println("Copied {} rows into table '{}' ({:.1f} MB in {:.2f}s, {:.1f} MB/s, {} threads)", newRows, tableName,
+                 text.size() / 1e6, seconds, text.size() / 1e6 / seconds, numChunks);
 }
 
-void dropTable(const vector<string> &query, Tables<int> &tables) {
-    auto tableName = query[2];
+/* -- Export:
+ *
+ *     copy table to path [csv | tsv] [where ...]
+ *
+ * Writes the matching rows with a header line, in the format `copy from` reads. Rows are rendered by `ResultWriter`
+ * into its buffer and written out in large blocks.
+ */
+void processCopyTo(const string &tableName, const string &path, OutputMode mode, Tokens query,
+                   Tables<int> &tables) {
+    auto start = chrono::steady_clock::now();
+    auto &table = tables.tables[tableName];
 
-    if (query.size() < 3 || query[0] != "drop" || query[1] != "table") {
-        fmt::println("Incorrect drop table syntax. Expected: DROP TABLE <tableName>");
-        return;
+    bool isWherePresent = false;
+    CompiledWhere pattern;
+    if (find(query.begin(), query.end(), DBCommands::where) != query.end()) {
+        WherePattern parsedPattern;
+        if (!processWhereStatement(query, parsedPattern) || !compileWherePattern(parsedPattern, table, pattern)) {
+            return;
+        }
+        isWherePresent = true;
     }
 
-    if (!tables.tables.contains(tableName)) {
-        fmt::println("Table '{}' does not exist.", tableName);
+    FILE *out = fopen(path.c_str(), "wb");
+    if (!out) {
+        fmt::println("Could not open file '{}'", path);
         return;
     }
 
+    vector<string> names;
+    vector<const Column *> columns;
+    for (const auto &columnSchema: table.schema.columns) {
+        names.push_back(columnSchema.name);
+        columns.push_back(&table.columns[columnSchema.ordinal]);
+    }
 
-    deleteTable(tableName, tables);
-    tables.primaryKeys.erase(tableName);
-
-    erase_if(tables.foreignKeys, [&tableName](ForeignKey key) {
-        return key.referencedTable == tableName || key.referencingTable == tableName;
-    });
+    size_t rows = 0;
+    {
+        ResultWriter writer(tables.outputBuffer, mode, out);
+        writer.header(names);
+        forEachMatchingRow(isWherePresent ? &pattern : nullptr, table.numRows, [&](size_t rowIdx) {
+            writer.row(columns, rowIdx);
+        });
+        writer.finish();
+        rows = writer.rows();
+    }
 
+    long bytes = ftell(out);
+    bool failed = ferror(out) != 0;
+    if (fclose(out) != 0 || failed) {
+        fmt::println("Could not write file '{}'", path);
+        return;
+    }
 
-    fmt::println("Table '{}' dropped successfully.", tableName);
+    double seconds = max(chrono::duration<double>(chrono::steady_clock::now() - start).count(), 1e-9);
+    fmt::println("Copied {} rows from table '{}' to '{}' ({:.1f} MB in {:.2f}s, {:.1f} MB/s)", rows, tableName, path,
+                 bytes / 1e6, seconds, bytes / 1e6 / seconds);
 }
 
+// copy <table> from <path> [csv|tsv]  |  copy <table> to <path> [csv|tsv] [where ...]
+void processCopy(Tokens query, Tables<int> &tables) {
+    bool isFrom = query.size() >= 4 && query[2] == "from";
+    bool isTo = query.size() >= 4 && query[2] == "to";
+    if (!isFrom && !isTo) {
+        fmt::println("usage: copy <table> from <path> [csv|tsv] | copy <table> to <path> [csv|tsv] [where ...]");
+        return;
+    }
 
-void processAlter(const vector<string> &query, Tables<int> &tables) {
-    auto tableName = query[2];
-
+    string tableName(query[1]);
     if (!tables.tables.contains(tableName)) {
         fmt::println("Table '{}' does not exist.", tableName);
         return;
     }
 
-    auto table = tables.tables[tableName].rowColumn;
+    // The format option of `copy to` is followed by the WHERE clause, if any
+    Tokens options = query.subspan(4);
+    if (isTo) {
+        options = options.first(find(options.begin(), options.end(), DBCommands::where) - options.begin());
+    }
+    if (options.size() > 1) {
+        fmt::println("unexpected '{}' in copy statement", options[1]);
+        return;
+    }
 
-    //start processing from index 3
-    for (int i = 3; i < query.size(); i++) {
-        if (query[i] == DBCommands::add) {
-            processAdd(query, tables, tableName);
-        }
-        if (query[i] == DBCommands::drop) {
-            alterTableDropColumn(query, tables, tableName);
-        }
-        if (query[i] == DBCommands::foreign) {
-            processForeignKey(query, tables, tableName);
+    bool isTsv = false;
+    if (!options.empty()) {
+        if (options[0] != "csv" && options[0] != "tsv") {
+            fmt::println("unknown copy format '{}'", options[0]);
+            return;
         }
+        isTsv = options[0] == "tsv";
     }
 
+    if (isFrom) {
+        processCopyFrom(tableName, string(tokenText(query[3])), isTsv ? CopyFormat{'\t', false} : CopyFormat{}, tables);
+    } else {
+        processCopyTo(tableName, string(tokenText(query[3])), isTsv ? OutputMode::Tsv : OutputMode::Csv, query, tables);
+    }
 }
 
 
-void processFile(const vector<string> &query, Tables<int> &tables) {
-    auto path = query[1];
-    auto file = fstream(path);
-    string word = "";
-    vector<string> toExecute;
+/* Appends a batch of `rows` strings to a dictionary-encoded column of up to `dictionaryMaxEntries` rows holding 10
+ * values, and checks every row afterwards. The batch holds `distinct` values in ascending runs, so it stays
+ * dictionary-encoded itself; with more values than the column accepts, the column switches to plain strings while
+ * translating the batch.
+ */
+void benchmarkStringAppend(size_t rows) {
+    size_t existing = clamp<size_t>(rows / 8, 1, dictionaryMaxEntries);
+    fmt::println("{:<10} {:>10} {:>12} {:<10} {}", "batch", "distinct", "Mrows/s", "form", "result");
+    for (size_t distinct: {size_t(10), clamp<size_t>(rows / 4, 1, dictionaryMaxEntries)}) {
+        auto batchValue = [&](size_t row) { return fmt::format("w{}", row * distinct / rows); };
+        StringColumn column, batch;
+        for (size_t row = 0; row < existing; ++row) column.push_back(fmt::format("v{}", row % 10));
+        for (size_t row = 0; row < rows; ++row) batch.push_back(batchValue(row));
+
+        auto start = chrono::steady_clock::now();
+        column.append(std::move(batch));
+        double seconds = max(chrono::duration<double>(chrono::steady_clock::now() - start).count(), 1e-9);
+
+        bool valid = column.size() == existing + rows;
+        for (size_t row = 0; valid && row < existing; ++row) valid = column[row] == fmt::format("v{}", row % 10);
+        for (size_t row = 0; valid && row < rows; ++row) valid = column[existing + row] == batchValue(row);
+        fmt::println("{:<10} {:>10} {:>12.1f} {:<10} {}", rows, distinct, rows / seconds / 1e6,
+                     column.isDictionaryEncoded() ? "dictionary" : "plain", valid ? "ok" : "MISMATCH");
+    }
+}
 
-    if (!filesystem::exists(path)) {
-        fmt::println("no such file exists");
+/* Micro-benchmarks:
+ *
+ *     bench filter [rows]
+ *     bench append [rows]
+ *
+ * `filter` runs every operator over random int and float columns with each supported kernel level, checks the masks
+ * against the scalar kernels and prints the throughput. `append` checks string batch appends, see
+ * benchmarkStringAppend.
+ */
+void processBenchmark(Tokens query) {
+    if (query.size() < 2 || (query[1] != "filter" && query[1] != "append")) {
+        fmt::println("usage: bench <filter|append> [rows]");
         return;
     }
 
-
-    while (file >> word) {
-        toExecute.push_back(word);
+    size_t rows = query[1] == "filter" ? 16 * 1024 * 1024 : 1024 * 1024;
+    if (query.size() > 2) {
+        auto parsed = from_chars(query[2].data(), query[2].data() + query[2].size(), rows);
+        if (parsed.ec != errc() || rows == 0) {
+            fmt::println("invalid row count '{}'", query[2]);
+            return;
+        }
     }
-
-    auto vectorOfCreateQueries = defineNumberOfCreateStatements(toExecute);
-
-    for (const auto &item: vectorOfCreateQueries) {
-        processCreate(item, tables);
+    if (query[1] == "append") {
+        benchmarkStringAppend(rows);
+        return;
     }
 
-
-    auto vectorOfInsertQueries = defineNumberOfInsertStatements(toExecute);
-
-    for (auto &item: vectorOfInsertQueries) {
-        processInsert(item, tables);
+    mt19937 generator(42);
+    uniform_int_distribution<int32_t> intDistribution(-1000, 1000);
+    uniform_real_distribution<float> floatDistribution(-1000.0f, 1000.0f);
+    vector<int32_t> ints(rows);
+    vector<float> floats(rows);
+    for (size_t i = 0; i < rows; ++i) {
+        ints[i] = intDistribution(generator);
+        floats[i] = floatDistribution(generator);
     }
 
-    auto vectorOfAlterStatements = defineNumberOfAlterStatements(toExecute);
-
-    for (const auto &item: vectorOfAlterStatements) {
-        processAlter(item, tables);
+    const array<const char *, compareOpCount> opNames{"=", "<", ">", "<=", ">="};
+    size_t maskWords = (rows + 63) / 64;
+    vector<uint64_t> expected(maskWords);
+    vector<uint64_t> mask(maskWords);
+
+    auto measure = [&](auto &&kernelRun) {
+        auto start = chrono::steady_clock::now();
+        kernelRun();
+        return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    };
+
+    fmt::println("{:<8} {:<6} {:<4} {:>12} {:>9} {}", "kernel", "type", "op", "Mrows/s", "speedup", "result");
+    for (size_t op = 0; op < compareOpCount; ++op) {
+        for (bool isFloat: {false, true}) {
+            const auto &scalar = filterKernels(KernelLevel::Scalar);
+            double scalarSeconds = isFloat
+                                   ? measure([&] { scalar.floats[op](floats.data(), rows, 0.0f, expected.data()); })
+                                   : measure([&] { scalar.ints[op](ints.data(), rows, 0, expected.data()); });
+
+            for (KernelLevel level: {KernelLevel::Scalar, KernelLevel::Sse42, KernelLevel::Avx2}) {
+                if (!isKernelLevelSupported(level)) continue;
+                const auto &kernels = filterKernels(level);
+                double seconds = isFloat
+                                 ? measure([&] { kernels.floats[op](floats.data(), rows, 0.0f, mask.data()); })
+                                 : measure([&] { kernels.ints[op](ints.data(), rows, 0, mask.data()); });
+                fmt::println("{:<8} {:<6} {:<4} {:>12.1f} {:>8.2f}x {}", kernels.name, isFloat ? "float" : "int",
+                             opNames[op], rows / seconds / 1e6, scalarSeconds / seconds,
+                             mask == expected ? "ok" : "MISMATCH");
+            }
+        }
     }
-
-
-    fmt::println("{}", toExecute);
-
+    fmt::println("active kernels: {}", activeFilterKernels().name);
 }
 
 
-void processSave(const string &filePath, Tables<int> &tables) {
-    std::ofstream out(filePath);  // overwrite the file
-    if (!out.is_open()) {
-        fmt::println("Could not open file '{}'", filePath);
+// set output pretty | csv | tsv | quiet, or set sync (see processSetSync)
+void processSet(Tokens query, Tables<int> &tables) {
+    if (query.size() >= 2 && query[1] == "sync") {
+        processSetSync(query, tables);
         return;
     }
-    tables.savingPath = filePath;
-
-    for (const auto &[tableName, rowColumn]: tables.tables) {
-        const auto &columns = rowColumn.rowColumn;
-        if (columns.empty()) continue;
-
-        out << "Table: " << tableName << "\n";
-
-        std::vector<std::string> actualColumnsToPrint;
-        for (const auto &[colName, _]: columns) {
-            actualColumnsToPrint.push_back(colName);
-        }
-
-        // Header
-        for (const auto &colName: actualColumnsToPrint) {
-            out << fmt::format("| {:15} ", colName);
-        }
-        out << "|\n";
-
-        // Separator
-        for (size_t i = 0; i < actualColumnsToPrint.size(); ++i) {
-            out << fmt::format("|{:-^17}", "");
-        }
-        out << "|\n";
-
-        // Row count
-        int numRows = columns.begin()->second.size();
-
-        // Rows
-        for (int rowIdx = 0; rowIdx < numRows; ++rowIdx) {
-            for (const auto &colName: actualColumnsToPrint) {
-                const auto &cell = columns.at(colName)[rowIdx];
-                std::string value = std::visit([](auto &&v) { return fmt::format("{}", v); }, cell);
-                out << fmt::format("| {:15} ", value);
-            }
-            out << "|\n";
-        }
-
-        out << "\n";
+    if (query.size() != 3 || query[1] != "output") {
+        fmt::println("usage: set output <pretty|csv|tsv|quiet> or set sync <always|group [milliseconds]|off>");
+        return;
     }
 
-    fmt::println("All tables saved to '{}'", filePath);
+    string_view mode = query[2];
+    if (mode == "pretty") {
+        tables.outputMode = OutputMode::Pretty;
+    } else if (mode == "csv") {
+        tables.outputMode = OutputMode::Csv;
+    } else if (mode == "tsv") {
+        tables.outputMode = OutputMode::Tsv;
+    } else if (mode == "quiet") {
+        tables.outputMode = OutputMode::Quiet;
+    } else {
+        fmt::println("unknown output mode '{}'", mode);
+        return;
+    }
+    fmt::println("output mode set to {}", mode);
 }
 
 
-void processQuery(vector<string> query, Tables<int> &tables) {
+void dispatchStatement(Tokens query, Tables<int> &tables) {
     if (query[0] == "exit") {
+        if (tables.wal) {
+            processCheckpoint(tables);
+            finishCheckpoint(tables, true);
+            tables.wal->close();
+            fmt::println("program terminated, checkpoint is written");
+            exit(0);
+        }
         if (tables.savingPath == "") {
             fmt::println("provide a path for back up");
             string path;
@@ -1234,13 +5802,38 @@ void processQuery(vector<string> query, Tables<int> &tables) {
         return;
     }
 
+    if (query[0] == DBCommands::set) {
+        processSet(query, tables);
+        return;
+    }
+
+    if (query[0] == DBCommands::bench) {
+        processBenchmark(query);
+        return;
+    }
+
     if (query[0] == DBCommands::load) {
         processFile(query, tables);
         return;
     }
 
+    if (query[0] == DBCommands::open) {
+        processOpen(query, tables);
+        return;
+    }
+
+    if (query[0] == DBCommands::checkpoint) {
+        processCheckpoint(tables);
+        return;
+    }
+
     if (query[0] == DBCommands::save) {
-        processSave(query[1], tables);
+        if (query.size() < 2) {
+            fmt::println("usage: save <path>");
+            return;
+        }
+        processSave(string(tokenText(query[1])), tables);
+        return;
     }
 
     if (query[0] == DBCommands::drop) {
@@ -1254,36 +5847,57 @@ void processQuery(vector<string> query, Tables<int> &tables) {
         return;
     }
 
-    auto vectorOfCreateQueries = defineNumberOfCreateStatements(query);
-
-    for (const auto &item: vectorOfCreateQueries) {
-        processCreate(item, tables);
+    if (query[0] == DBCommands::create) {
+        processCreate(query, tables);
+        return;
     }
 
+    if (query[0] == DBCommands::alter) {
+        processAlter(query, tables);
+        return;
+    }
 
-    auto vectorOfAlterStatements = defineNumberOfAlterStatements(query);
-
-    for (const auto &item: vectorOfAlterStatements) {
-        processAlter(item, tables);
+    if (query[0] == DBCommands::insert) {
+        processInsert(query, tables);
+        return;
     }
 
+    if (query[0] == DBCommands::copy) {
+        processCopy(query, tables);
+        return;
+    }
 
-    auto vectorOfInsertQueries = defineNumberOfInsertStatements(query);
+    fmt::println("unknown statement '{}'", query[0]);
+}
 
-    for (auto &item: vectorOfInsertQueries) {
-        processInsert(item, tables);
-    }
+/* Runs one statement. With a write-ahead log attached, the schema changes and updates that modified something are
+ * logged as their tokens; rows are logged by commitAppendedRows, snapshots loaded by `load` or `open` checkpoint.
+ * A finished background checkpoint is taken over first, and a new one starts once the log has grown large.
+ */
+void executeStatement(Tokens query, Tables<int> &tables) {
+    finishCheckpoint(tables, false);
+    uint64_t changes = tables.changes;
+    dispatchStatement(query, tables);
+
+    bool logged = query[0] == DBCommands::create || query[0] == DBCommands::alter || query[0] == DBCommands::drop ||
+                  query[0] == DBCommands::update;
+    if (tables.wal && logged && tables.changes != changes) logStatement(query, tables);
+    if (tables.wal && !tables.checkpoint && tables.wal->loggedBytes() >= checkpointLogSize) processCheckpoint(tables);
+}
 
 
-    return;
+// Runs every statement of the query in the order they are written
+void processQuery(Tokens query, Tables<int> &tables) {
+    splitStatements(query, [&](Tokens statement) { executeStatement(statement, tables); });
 }
 
 
-void startProgram() {
-    vector<string> query;
+void startProgram(const string &dataDirectory) {
+    string statement;
+    vector<string_view> query;
     string line;
     Tables<int> tables;
-
+    if (!dataDirectory.empty()) openDataDirectory(dataDirectory, tables);
 
     cout << "Program started, now you can enter sql commands\n";
 
@@ -1292,26 +5906,30 @@ void startProgram() {
             break;
         }
         cout << "Enter your multi-line SQL statement (press Enter on an empty line to finish):\n";
+        statement.clear();
         while (getline(cin, line)) {
             if (line.empty()) break;// stop on empty line
-            auto words = deleteSpaces(line);
-            for (auto &word: words) {
-                query.push_back(word);
-            }
+            statement += line;
+            statement += '\n';
+        }
+        if (statement.empty() && !cin) {
+            break;
         }
 
-        toLower(query);
+        query.clear();
+        tokenize(statement, query);
 
         processQuery(query, tables);
-        query.clear();
         cout << "query was entered\n";
 
 
     }
+    finishCheckpoint(tables, true);
     cout << "program stopped\n";
 }
 
 
-int main() {
-    startProgram();
+// Usage: cpp_Project [data directory]
+int main(int argc, char **argv) {
+    startProgram(argc > 1 ? argv[1] : "");
 }